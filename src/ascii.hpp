@@ -0,0 +1,42 @@
+#ifndef ASCII_HPP
+#define ASCII_HPP
+
+#include <cstddef>
+
+constexpr char to_lower_ascii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Character classes of license.peg's tokens. Whitespace within a line is only space and tab.
+constexpr bool is_whitespace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+constexpr bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+constexpr bool is_alpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+// Anything that may appear in an IPv4 or IPv6 network
+constexpr bool is_network_char(char c)
+{
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || c == ':' || c == '.';
+}
+
+// The length of the UTF-8 sequence that 'lead' starts, judged from that byte alone as peglib's '.' does - 0 for a byte
+// that cannot start one
+constexpr size_t utf8_sequence_length(char lead)
+{
+    const auto b = static_cast<unsigned char>(lead);
+    if ((b & 0x80) == 0) return 1;
+    if ((b & 0xE0) == 0xC0) return 2;
+    if ((b & 0xF0) == 0xE0) return 3;
+    if ((b & 0xF8) == 0xF0) return 4;
+    return 0;
+}
+
+#endif /* ASCII_HPP */
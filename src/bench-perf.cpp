@@ -0,0 +1,137 @@
+#include "bench-perf.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+struct event_config_t
+{
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr event_config_t event_configs[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+// Counts this thread in user space only, which needs no privileges at the default perf_event_paranoid level
+int open_event(const event_config_t &event)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+} // namespace
+
+perf_counters_t::perf_counters_t()
+{
+    static_assert(std::size(event_configs) == event_count);
+    for (size_t i = 0; i < event_count; ++i)
+        fds[i] = open_event(event_configs[i]);
+}
+
+perf_counters_t::~perf_counters_t()
+{
+    for (const auto fd : fds)
+    {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void perf_counters_t::start()
+{
+    for (const auto fd : fds)
+    {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_counters_t::stop()
+{
+    for (const auto fd : fds)
+    {
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (size_t i = 0; i < event_count; ++i)
+    {
+        values[i].reset();
+        uint64_t data[3]; // value, time enabled, time running
+        if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) continue;
+        if (data[2] != 0)
+            values[i] = static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        else if (data[1] == 0)
+            values[i] = 0.0;
+        // Otherwise it was enabled but never scheduled, so its count is unknown
+    }
+}
+#else
+perf_counters_t::perf_counters_t()
+{
+    fds.fill(-1);
+}
+
+perf_counters_t::~perf_counters_t() = default;
+
+void perf_counters_t::start() {}
+
+void perf_counters_t::stop() {}
+#endif
+
+const char *perf_counters_t::name(event_t event)
+{
+    switch (event)
+    {
+    case cycles:
+        return "cycles";
+    case instructions:
+        return "instructions";
+    case branch_misses:
+        return "branch-misses";
+    case l1d_misses:
+        return "L1d-misses";
+    case llc_misses:
+        return "LLC-misses";
+    case page_faults:
+        return "page-faults";
+    case event_count:
+        break;
+    }
+    return "unknown";
+}
+
+bool perf_counters_t::available() const
+{
+    for (const auto fd : fds)
+    {
+        if (fd >= 0) return true;
+    }
+    return false;
+}
+
+std::optional<double> perf_counters_t::value(event_t event) const
+{
+    return values[event];
+}
@@ -0,0 +1,44 @@
+#ifndef BENCH_PERF_HPP
+#define BENCH_PERF_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Hardware and software event counters for the benchmark harness, read through perf_event_open on Linux. Each
+// counter is opened on its own, so one the CPU, kernel or container does not allow is reported as missing rather than
+// taking the others with it; elsewhere, every counter is missing.
+class perf_counters_t
+{
+ public:
+    enum event_t
+    {
+        cycles,
+        instructions,
+        branch_misses,
+        l1d_misses,
+        llc_misses,
+        page_faults,
+        event_count
+    };
+
+    perf_counters_t();
+    perf_counters_t(const perf_counters_t &) = delete;
+    perf_counters_t &operator=(const perf_counters_t &) = delete;
+    ~perf_counters_t();
+
+    static const char *name(event_t event);
+    bool available() const;
+
+    void start();
+    void stop();
+    // The count between the last start and stop, scaled up if the kernel had to multiplex the counter
+    std::optional<double> value(event_t event) const;
+
+ private:
+    std::array<int, event_count> fds;
+    std::array<std::optional<double>, event_count> values;
+};
+
+#endif /* BENCH_PERF_HPP */
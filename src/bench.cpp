@@ -0,0 +1,741 @@
+#include "bench.hpp"
+
+#include "license-check.hpp"
+#include "license-client.hpp"
+#include "license-decision.hpp"
+#include "license-entitlement.hpp"
+#include "license-expiry.hpp"
+#include "license-index.hpp"
+#include "license-keywords.hpp"
+#include "license-parser.hpp"
+#include "license-protocol.hpp"
+#include "license-recognizer.hpp"
+#include "license-revocation.hpp"
+#include "license-server.hpp"
+#include "license-shared.hpp"
+#include "license-validity.hpp"
+#include "license.peg.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <peglib.h>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace
+{
+struct benchmark_t
+{
+    const char *name;
+    benchmark_fn_t fn;
+};
+
+std::vector<benchmark_t> &benchmarks()
+{
+    static std::vector<benchmark_t> registered;
+    return registered;
+}
+
+const std::string_view month_names[] = {"January", "February", "March",     "April",   "May",      "June",
+                                        "July",    "August",   "September", "October", "November", "December"};
+
+// Each of these is rejected either by the grammar or by a semantic action
+const std::string_view bad_files[] = {
+    "secret=abc\nuser=stu\nexpiry=2019-02-30\n",
+    "secret=abc\nuser=stu\nexpiry=31 feb 2019\n",
+    "secret=abc\nuser=stu\nexpiry=99999 days\n",
+    "secret=abc\nuser=stu\nnetwork=10.0.0.0/33\n",
+    "secret=abc\nuser=stu\nexpiry sometime\n",
+};
+
+// A site license of a few megabytes, of the kind found in bundle dumps
+const std::string &large_license()
+{
+    static const auto text = [] {
+        std::string text = "secret = large site license\nexpiry = 2 years\n";
+        for (int i = 0; i < 20000; ++i)
+        {
+            text += fmt::format("user = user{}@example.com\n", i);
+            text += fmt::format("node = build-{}-*\n", i);
+            text += fmt::format("network = 10.{}.{}.0/24\n", i / 256 % 256, i % 256);
+        }
+        return text;
+    }();
+    return text;
+}
+
+const auto check_day = date::year_month_day{date::year{2019} / 7 / 30};
+
+license_store_t check_store()
+{
+    license_store_t store;
+    const auto license = parse_license(check_day, "secret=build\nexpiry=1 year\nuser=stu\ndomain=example.com\n"
+                                                  "node=build-*\nnetwork=10.0.0.0/8\n",
+                                       std::nullopt);
+    store.add("build", resolved_license_t(*license, check_day));
+    return store;
+}
+
+// A directory of 1000 licenses, written once
+const std::filesystem::path &license_farm()
+{
+    static const auto directory = [] {
+        const auto path = std::filesystem::temp_directory_path() / "license-bench-farm";
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+        for (int i = 0; i < 1000; ++i)
+            std::ofstream(path / fmt::format("{}.lic", i))
+                << fmt::format("secret=s{}\nexpiry=1 year\nuser=u{}\ndomain=example.com\nnode=build-*\n"
+                               "network=10.0.0.0/8\n",
+                               i, i);
+        return path;
+    }();
+    return directory;
+}
+
+// 'count' licenses, each for one user on one of a thousand nodes, with every hundredth for a whole domain instead
+std::vector<license_t> entitlement_licenses(size_t count)
+{
+    std::vector<license_t> licenses(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto &license = licenses[i];
+        license.secret = fmt::format("s{}", i);
+        license.expiry = date::year_month_day{date::year{2020} / 1 / 1};
+        if (i % 100 == 0)
+            license.allowed_users.emplace_back(domain_t{fmt::format("d{}.example.com", i)});
+        else
+            license.allowed_users.emplace_back(user_t{fmt::format("u{}", i)});
+        license.allowed_places.emplace_back(node_t{fmt::format("n{}", i % 1000)});
+    }
+    return licenses;
+}
+
+const entitlement_index_t &entitlement_index(size_t count)
+{
+    static std::map<size_t, entitlement_index_t> indexes;
+    auto &index = indexes[count];
+    if (index.size() == 0)
+    {
+        for (const auto &license : entitlement_licenses(count))
+            index.add(license.secret, license, check_day);
+    }
+    return index;
+}
+
+void entitlement_benchmark(benchmark_state_t &state, size_t count)
+{
+    const auto &index = entitlement_index(count);
+    const auto user = fmt::format("u{}", count / 2 + 1);
+    const auto node = fmt::format("n{}", (count / 2 + 1) % 1000);
+    for (auto _ : state)
+        do_not_optimize(index.grants(user, node, check_day));
+}
+
+void entitlement_scan_benchmark(benchmark_state_t &state, size_t count)
+{
+    std::vector<resolved_license_t> licenses;
+    for (const auto &license : entitlement_licenses(count))
+        licenses.emplace_back(license, check_day);
+    const auto user = fmt::format("u{}", count / 2 + 1);
+    const auto node = fmt::format("n{}", (count / 2 + 1) % 1000);
+    for (auto _ : state)
+        do_not_optimize(std::any_of(licenses.begin(), licenses.end(), [&](const resolved_license_t &license) {
+            return license.check(user, node, check_day) == check_result_t::allowed;
+        }));
+}
+
+// 100k licenses issued over twenty years, mostly for a year or a few months, of which about 6% are valid on a day
+std::vector<std::pair<date::year_month_day, expiry_t>> validity_licenses()
+{
+    std::vector<std::pair<date::year_month_day, expiry_t>> licenses;
+    const auto first = date::sys_days{date::year{2000} / 1 / 1};
+    for (int i = 0; i < 100000; ++i)
+    {
+        const auto issued = date::year_month_day{first + date::days{(i * 7919) % 7300}};
+        expiry_t expiry = term_length_t{1, term_length_t::year};
+        if (i % 3 == 0) expiry = term_length_t{static_cast<uint16_t>(1 + i % 6), term_length_t::month};
+        if (i % 50 == 0) expiry = date::year_month_day{date::sys_days{issued} + date::days{i % 1000}};
+        if (i % 1000 == 0) expiry = perpetual_t{};
+        licenses.emplace_back(issued, expiry);
+    }
+    return licenses;
+}
+
+// Ten million revoked hashes, none of them the secret of check_store's license
+std::vector<uint64_t> revoked_hashes()
+{
+    std::mt19937_64 random(1);
+    std::vector<uint64_t> hashes(10000000);
+    for (auto &hash : hashes)
+        hash = random();
+    return hashes;
+}
+
+// Hashes that are not revoked, too many to stay in the cache together with the parts of a list they touch
+std::vector<uint64_t> revocation_probes()
+{
+    std::mt19937_64 random(2);
+    std::vector<uint64_t> probes(1 << 16);
+    for (auto &probe : probes)
+        probe = random();
+    return probes;
+}
+
+#if defined(__linux__)
+// A licensed serving check_store from a thread of this process, and one connection to it
+class daemon_fixture_t
+{
+ public:
+    daemon_fixture_t() : store(check_store()), server(store)
+    {
+        server.listen(path);
+        serving = std::thread([this] { server.run(); });
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.native().size());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+    ~daemon_fixture_t()
+    {
+        close(fd);
+        server.stop();
+        serving.join();
+    }
+
+    // Sends every request in one write and waits for all the responses
+    void round_trip(const std::string &requests, size_t count)
+    {
+        send(fd, requests.data(), requests.size(), MSG_NOSIGNAL);
+        char responses[4096];
+        for (size_t got = 0; got < count * check_response_size;)
+        {
+            const auto n = read(fd, responses, sizeof(responses));
+            if (n <= 0) return;
+            got += static_cast<size_t>(n);
+        }
+    }
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "licensed-bench.sock";
+
+ private:
+    license_store_t store;
+    license_server_t server;
+    std::thread serving;
+    int fd = -1;
+};
+
+void daemon_benchmark(benchmark_state_t &state, size_t batch)
+{
+    daemon_fixture_t daemon;
+    std::string requests;
+    for (uint32_t i = 0; i < batch; ++i)
+        encode_check_request({i, date::sys_days{check_day}, "build", "stu", "build-1"}, requests);
+    for (auto _ : state)
+        daemon.round_trip(requests, batch);
+}
+#endif
+
+void structural_index_benchmark(benchmark_state_t &state, index_kernel_t kernel)
+{
+    // Without running the loop, a kernel this CPU lacks shows as 0 ns/op
+    if (kernel > best_index_kernel()) return;
+    const auto &text = large_license();
+    structural_index_t index;
+    for (auto _ : state)
+    {
+        build_structural_index(text, index, kernel);
+        do_not_optimize(index.line_ends.size());
+    }
+}
+} // namespace
+
+benchmark_registration_t::benchmark_registration_t(const char *name, benchmark_fn_t fn)
+{
+    benchmarks().push_back({name, fn});
+}
+
+BENCHMARK("MonthName/peglib")
+{
+    auto p = *prepare_parser();
+    const auto &rule = p["MonthName"];
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &name = month_names[i++ % 12];
+        do_not_optimize(rule.parse(name.data(), name.size()).len);
+    }
+}
+
+BENCHMARK("MonthName/perfect-hash")
+{
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &name = month_names[i++ % 12];
+        do_not_optimize(find_keyword(name));
+    }
+}
+
+BENCHMARK("BadFiles/exceptions")
+{
+    const auto p = *prepare_parser();
+    const auto now = date::year_month_day{date::year{2019} / 7 / 30};
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &text = bad_files[i++ % std::size(bad_files)];
+        do_not_optimize(parse_license(p, now, text, std::nullopt).has_value());
+    }
+}
+
+BENCHMARK("BadFiles/diagnostics")
+{
+    const auto p = *prepare_parser();
+    const auto now = date::year_month_day{date::year{2019} / 7 / 30};
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &text = bad_files[i++ % std::size(bad_files)];
+        do_not_optimize(try_parse_license(p, now, text, std::nullopt).diagnostics.size());
+    }
+}
+
+BENCHMARK("StructuralIndex/scalar")
+{
+    structural_index_benchmark(state, index_kernel_t::scalar);
+}
+
+BENCHMARK("StructuralIndex/sse2")
+{
+    structural_index_benchmark(state, index_kernel_t::sse2);
+}
+
+BENCHMARK("StructuralIndex/avx2")
+{
+    structural_index_benchmark(state, index_kernel_t::avx2);
+}
+
+BENCHMARK("LargeLicense/peglib")
+{
+    const auto p = *prepare_parser();
+    const auto now = date::year_month_day{date::year{2019} / 7 / 30};
+    const auto &text = large_license();
+    for (auto _ : state)
+        do_not_optimize(try_parse_license(p, now, text, std::nullopt).license->allowed_users.size());
+}
+
+BENCHMARK("LargeLicense/indexed")
+{
+    const auto p = *prepare_parser();
+    const auto now = date::year_month_day{date::year{2019} / 7 / 30};
+    const auto &text = large_license();
+    for (auto _ : state)
+        do_not_optimize(parse_license_indexed(p, now, text, std::nullopt).license->allowed_users.size());
+}
+
+BENCHMARK("Recognize/peglib")
+{
+    peg::parser p;
+    p.load_grammar(license_peg);
+    const auto &text = large_license();
+    for (auto _ : state)
+        do_not_optimize(p.parse_n(text.data(), text.size()));
+}
+
+BENCHMARK("Recognize/generated")
+{
+    const auto &text = large_license();
+    for (auto _ : state)
+        do_not_optimize(recognize_license(text));
+}
+
+BENCHMARK("Check/in-process")
+{
+    const auto store = check_store();
+    for (auto _ : state)
+        do_not_optimize(store.check("build", "stu", "build-1", check_day));
+}
+
+// A user in the domain on a node in the network, the slowest way to be allowed
+BENCHMARK("Check/in-process-network")
+{
+    const auto store = check_store();
+    for (auto _ : state)
+        do_not_optimize(store.check("build", "alice@eng.example.com", "10.1.2.3", check_day));
+}
+
+BENCHMARK("Check/decision-cached")
+{
+    const auto store = check_store();
+    decision_cache_t cache;
+    for (auto _ : state)
+        do_not_optimize(cache.check(store, "build", "alice@eng.example.com", "10.1.2.3", check_day));
+}
+
+BENCHMARK("Check/in-process-revoked-10m")
+{
+    auto store = check_store();
+    revocation_set_t revocations;
+    revocations.replace(revocation_list_t(revoked_hashes()));
+    store.use_revocations(&revocations);
+    for (auto _ : state)
+        do_not_optimize(store.check("build", "stu", "build-1", check_day));
+}
+
+// One op is 4 threads making 16384 checks each, so the revocation set is shared the way a server shares it
+BENCHMARK("Check/in-process-revoked-10m-4-threads")
+{
+    auto store = check_store();
+    revocation_set_t revocations;
+    revocations.replace(revocation_list_t(revoked_hashes()));
+    store.use_revocations(&revocations);
+    for (auto _ : state)
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+            threads.emplace_back([&] {
+                for (int i = 0; i < 16384; ++i)
+                    do_not_optimize(store.check("build", "stu", "build-1", check_day));
+            });
+        for (auto &thread : threads)
+            thread.join();
+    }
+}
+
+// One op looks up a hash that is not revoked, a different one each time
+BENCHMARK("Revocation/sorted-miss-10m")
+{
+    auto sorted = revoked_hashes();
+    std::sort(sorted.begin(), sorted.end());
+    const auto probes = revocation_probes();
+    size_t i = 0;
+    for (auto _ : state)
+        do_not_optimize(std::binary_search(sorted.begin(), sorted.end(), probes[i++ % probes.size()]));
+}
+
+BENCHMARK("Revocation/filter-miss-10m")
+{
+    const revocation_list_t list(revoked_hashes());
+    const auto probes = revocation_probes();
+    size_t i = 0;
+    for (auto _ : state)
+        do_not_optimize(list.contains(probes[i++ % probes.size()]));
+}
+
+BENCHMARK("Revocation/filter-hit-10m")
+{
+    const auto hashes = revoked_hashes();
+    const revocation_list_t list(hashes);
+    size_t i = 0;
+    for (auto _ : state)
+        do_not_optimize(list.contains(hashes[(i++ * 7919) % hashes.size()]));
+}
+
+#if defined(__linux__)
+BENCHMARK("Check/daemon")
+{
+    daemon_benchmark(state, 1);
+}
+
+// One op is a batch of 64 checks
+BENCHMARK("Check/daemon-batch-64")
+{
+    daemon_benchmark(state, 64);
+}
+
+BENCHMARK("Check/client-cached")
+{
+    daemon_fixture_t daemon;
+    license_client_t client(daemon.path);
+    const auto day = date::sys_days{check_day};
+    for (auto _ : state)
+        do_not_optimize(client.check("build", "stu", "build-1", day));
+}
+#endif
+
+BENCHMARK("Entitlement/scan-10k")
+{
+    entitlement_scan_benchmark(state, 10000);
+}
+
+BENCHMARK("Entitlement/scan-100k")
+{
+    entitlement_scan_benchmark(state, 100000);
+}
+
+BENCHMARK("Entitlement/indexed-10k")
+{
+    entitlement_benchmark(state, 10000);
+}
+
+BENCHMARK("Entitlement/indexed-100k")
+{
+    entitlement_benchmark(state, 100000);
+}
+
+BENCHMARK("Entitlement/indexed-1m")
+{
+    entitlement_benchmark(state, 1000000);
+}
+
+// One op is a day, with 100k licenses expiring over ten years
+BENCHMARK("Expiry/daily-scan-100k")
+{
+    std::vector<date::sys_days> expiries;
+    for (int i = 0; i < 100000; ++i)
+        expiries.push_back(date::sys_days{check_day} + date::days{i % 3650});
+    auto day = date::sys_days{check_day};
+    for (auto _ : state)
+    {
+        day += date::days{1};
+        size_t events = 0;
+        for (const auto expiry : expiries)
+        {
+            for (const auto days_left : {30, 7, 1})
+                events += expiry - date::days{days_left} == day;
+            events += expiry + date::days{1} == day;
+        }
+        do_not_optimize(events);
+    }
+}
+
+BENCHMARK("Expiry/daily-wheel-100k")
+{
+    const auto today = date::sys_days{check_day};
+    expiry_scheduler_t scheduler(today);
+    for (int i = 0; i < 100000; ++i)
+        scheduler.schedule(std::to_string(i), today + date::days{i % 3650});
+    // Each license is renewed for another ten years as it expires, so every day has as much to do as the first
+    auto day = today;
+    size_t events = 0;
+    const auto renew = [&](const expiry_event_t &event) {
+        ++events;
+        if (event.kind == expiry_event_kind_t::expired)
+            scheduler.schedule(std::string(event.id), event.expiry + date::days{3650});
+    };
+    for (auto _ : state)
+    {
+        day += date::days{1};
+        scheduler.advance(day, renew);
+    }
+    do_not_optimize(events);
+}
+
+// One op finds every license valid on a day
+BENCHMARK("Validity/active-scan-100k")
+{
+    const auto licenses = validity_licenses();
+    std::vector<uint32_t> found;
+    for (auto _ : state)
+    {
+        found.clear();
+        for (uint32_t i = 0; i < licenses.size(); ++i)
+        {
+            const auto &[issued, expiry] = licenses[i];
+            if (issued <= check_day &&
+                check_day <= resolve_expiry(issued, get_earliest_expiry(issued, expiry, perpetual_t{})))
+                found.push_back(i);
+        }
+        do_not_optimize(found.size());
+    }
+}
+
+BENCHMARK("Validity/active-indexed-100k")
+{
+    validity_index_t index;
+    for (const auto &[issued, expiry] : validity_licenses())
+        index.add({}, issued, expiry);
+    index.build();
+    std::vector<uint32_t> found;
+    for (auto _ : state)
+    {
+        index.active_on(check_day, found);
+        do_not_optimize(found.size());
+    }
+}
+
+// One op finds every license expiring in the next week
+BENCHMARK("Validity/expiring-scan-100k")
+{
+    const auto licenses = validity_licenses();
+    const auto last = date::year_month_day{date::sys_days{check_day} + date::days{7}};
+    std::vector<uint32_t> found;
+    for (auto _ : state)
+    {
+        found.clear();
+        for (uint32_t i = 0; i < licenses.size(); ++i)
+        {
+            const auto &[issued, expiry] = licenses[i];
+            const auto end = resolve_expiry(issued, get_earliest_expiry(issued, expiry, perpetual_t{}));
+            if (check_day <= end && end <= last) found.push_back(i);
+        }
+        do_not_optimize(found.size());
+    }
+}
+
+BENCHMARK("Validity/expiring-indexed-100k")
+{
+    validity_index_t index;
+    for (const auto &[issued, expiry] : validity_licenses())
+        index.add({}, issued, expiry);
+    index.build();
+    const auto last = date::year_month_day{date::sys_days{check_day} + date::days{7}};
+    std::vector<uint32_t> found;
+    for (auto _ : state)
+    {
+        index.expiring_between(check_day, last, found);
+        do_not_optimize(found.size());
+    }
+}
+
+// One op is a day, with 100k licenses expiring over ten years and each renewed for ten more as it expires
+BENCHMARK("Store/daily-rescan-100k")
+{
+    std::vector<resolved_license_t> licenses;
+    license_t license;
+    for (int i = 0; i < 100000; ++i)
+    {
+        license.expiry = term_length_t{static_cast<uint16_t>(i % 3650), term_length_t::day};
+        licenses.emplace_back(license, check_day);
+    }
+    auto day = date::sys_days{check_day};
+    for (auto _ : state)
+    {
+        size_t changes = 0;
+        for (auto &resolved : licenses)
+        {
+            if (date::sys_days{resolved.expiry} != day) continue;
+            ++changes;
+            resolved.expiry = date::sys_days{resolved.expiry} + date::days{3650};
+        }
+        day += date::days{1};
+        do_not_optimize(changes);
+    }
+}
+
+BENCHMARK("Store/daily-advance-100k")
+{
+    license_store_t store(check_day);
+    license_t license;
+    for (int i = 0; i < 100000; ++i)
+    {
+        license.expiry = term_length_t{static_cast<uint16_t>(i % 3650), term_length_t::day};
+        store.add(std::to_string(i), resolved_license_t(license, check_day));
+    }
+    auto day = date::sys_days{check_day};
+    std::vector<status_change_t> changes;
+    for (auto _ : state)
+    {
+        day += date::days{1};
+        store.advance(day, changes);
+        for (const auto &change : changes)
+        {
+            auto renewed = *store.find(change.id);
+            renewed.expiry = date::sys_days{renewed.expiry} + date::days{3650};
+            store.add(std::string(change.id), std::move(renewed));
+        }
+    }
+}
+
+BENCHMARK("Store/load-files-1000")
+{
+    std::vector<std::string> errors;
+    for (auto _ : state)
+        do_not_optimize(load_license_store(license_farm(), check_day, errors).size());
+}
+
+#if defined(__linux__)
+BENCHMARK("Store/attach-shared-1000")
+{
+    std::vector<std::string> errors;
+    const std::string name = "/license-bench";
+    shared_license_publisher_t publisher(name);
+    publisher.publish(encode_license_image(load_licenses(license_farm(), check_day, errors), check_day));
+    for (auto _ : state)
+    {
+        license_store_t store;
+        do_not_optimize(attach_shared_licenses(name, store));
+    }
+    publisher.remove();
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    using namespace std::chrono;
+    bool perf = false;
+    std::string_view filter;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string_view(argv[i]) == "--perf")
+            perf = true;
+        else
+            filter = argv[i];
+    }
+    const auto min_time = duration<double>(0.2);
+
+    std::optional<perf_counters_t> counters;
+    if (perf)
+    {
+        counters.emplace();
+        if (!counters->available())
+        {
+            fmt::print(stderr, "no hardware counters are available here (see perf_event_paranoid); timing only\n");
+            counters.reset();
+        }
+    }
+
+    fmt::print("{:<40} {:>12} {:>12} {:>12} {:>12}", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+    for (size_t e = 0; counters && e < perf_counters_t::event_count; ++e)
+        fmt::print(" {:>13}", perf_counters_t::name(static_cast<perf_counters_t::event_t>(e)));
+    fmt::print("\n");
+    for (const auto &b : benchmarks())
+    {
+        if (std::string_view(b.name).find(filter) == std::string_view::npos) continue;
+        for (size_t iterations = 1;;)
+        {
+            benchmark_state_t state{iterations, counters ? &*counters : nullptr};
+            b.fn(state);
+            const auto elapsed = duration<double>(state.stop - state.start);
+            if (elapsed >= min_time || iterations >= (size_t(1) << 32))
+            {
+                fmt::print("{:<40} {:>12} {:>12.1f} {:>12.1f} {:>12.1f}", b.name, iterations,
+                           1e9 * elapsed.count() / iterations, double(state.allocations.allocations) / iterations,
+                           double(state.allocations.bytes) / iterations);
+                // Counts are per op; a benchmark that skipped its loop has none
+                for (size_t e = 0; counters && e < perf_counters_t::event_count; ++e)
+                {
+                    const auto value = counters->value(static_cast<perf_counters_t::event_t>(e));
+                    if (value && state.start != steady_clock::time_point{})
+                        fmt::print(" {:>13.1f}", *value / iterations);
+                    else
+                        fmt::print(" {:>13}", "-");
+                }
+                fmt::print("\n");
+                break;
+            }
+            // Aim a little past the minimum time, but never grow by more than 10x on a noisy short run
+            const auto estimate = 1.2 * iterations * min_time / std::max(elapsed, duration<double>(1e-9));
+            iterations = std::clamp<size_t>(static_cast<size_t>(estimate), iterations * 2, iterations * 10);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "bench-perf.hpp"
+#include "test-allocations.hpp"
+
+#include <chrono>
+#include <cstddef>
+
+// A minimal benchmark harness. Benchmarks register themselves with BENCHMARK and time a range-for loop over the
+// state, which the harness grows until a run takes long enough to measure:
+//
+//     BENCHMARK("MonthName/peglib")
+//     {
+//         auto p = *prepare_parser();
+//         for (auto _ : state)
+//             do_not_optimize(p["MonthName"].parse("OCTOBER"));
+//     }
+//
+// Only the loop is measured: by the clock, by the allocation counters and by any hardware counters the harness was
+// given.
+struct benchmark_state_t
+{
+    // What 'for (auto _ : state)' declares; the attribute keeps the compiler quiet about '_' never being used
+    struct [[maybe_unused]] iteration_t
+    {
+    };
+
+    struct iterator_t
+    {
+        benchmark_state_t *state;
+        size_t remaining;
+        bool operator!=(const iterator_t &)
+        {
+            if (remaining != 0) return true;
+            state->stop = std::chrono::steady_clock::now();
+            if (state->counters) state->counters->stop();
+            state->allocations = state->allocation_counter.counts();
+            return false;
+        }
+        void operator++() { --remaining; }
+        iteration_t operator*() const { return {}; }
+    };
+
+    benchmark_state_t(size_t iterations, perf_counters_t *counters) : iterations(iterations), counters(counters) {}
+
+    iterator_t begin()
+    {
+        allocation_counter = allocation_counter_t{};
+        if (counters) counters->start();
+        start = std::chrono::steady_clock::now();
+        return {this, iterations};
+    }
+    iterator_t end() { return {this, 0}; }
+
+    size_t iterations;
+    perf_counters_t *counters;
+    allocation_counter_t allocation_counter;
+    allocation_counts_t allocations;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point stop;
+};
+
+using benchmark_fn_t = void (*)(benchmark_state_t &state);
+
+struct benchmark_registration_t
+{
+    benchmark_registration_t(const char *name, benchmark_fn_t fn);
+};
+
+template <class T>
+void do_not_optimize(T const &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+#define BENCH_CONCAT_IMPL(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_IMPL(a, b)
+#define BENCHMARK_IMPL(fn, name)                                                                                       \
+    static void fn(benchmark_state_t &state);                                                                          \
+    static const benchmark_registration_t BENCH_CONCAT(fn, _registration){name, fn};                                  \
+    static void fn(benchmark_state_t &state)
+#define BENCHMARK(name) BENCHMARK_IMPL(BENCH_CONCAT(benchmark_, __LINE__), name)
+
+#endif /* BENCH_HPP */
@@ -0,0 +1,314 @@
+#include "license-check.hpp"
+
+#include "license-files.hpp"
+#include "license-network.hpp"
+#include "license-parser.hpp"
+#include "license-revocation.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include <fmt/core.h>
+#include <peglib.h>
+
+#include <doctest/doctest.h>
+
+const char *to_string(check_result_t result)
+{
+    switch (result)
+    {
+    case check_result_t::allowed:
+        return "allowed";
+    case check_result_t::unknown_license:
+        return "unknown license";
+    case check_result_t::expired:
+        return "expired";
+    case check_result_t::user_denied:
+        return "user denied";
+    case check_result_t::node_denied:
+        return "node denied";
+    case check_result_t::revoked:
+        return "revoked";
+    }
+    return "unknown result";
+}
+
+resolved_license_t::resolved_license_t(const license_t &license, const date::year_month_day &issue_date)
+    : secret(license.secret),
+      expiry(resolve_expiry(issue_date, license)),
+      users(license.allowed_users),
+      places(license.allowed_places)
+{
+}
+
+check_result_t resolved_license_t::check(std::string_view user,
+                                         std::string_view node,
+                                         const date::year_month_day &date) const
+{
+    if (date > expiry) return check_result_t::expired;
+    if (!users.matches(user)) return check_result_t::user_denied;
+    if (places.matches_node(node)) return check_result_t::allowed;
+    const auto address = parse_ip_address(node);
+    return address && places.matches_address(*address) ? check_result_t::allowed : check_result_t::node_denied;
+}
+
+uint64_t next_license_generation()
+{
+    static std::atomic<uint64_t> generations{0};
+    return generations.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void license_store_t::add(std::string id, resolved_license_t license)
+{
+    current_generation = next_license_generation();
+    const auto expiry = date::sys_days{license.expiry};
+    if (const auto found = index.find(id); found != index.end())
+    {
+        auto &entry = entries[found->second];
+        entry.license = std::move(license);
+        entry.generation = current_generation;
+        expiries.erase(entry.expiry);
+        entry.expiry = expiries.emplace(expiry, found->second);
+        return;
+    }
+    entries.push_back(
+        {std::move(id), std::move(license), expiries.emplace(expiry, entries.size()), current_generation});
+    index.emplace(entries.back().id, entries.size() - 1);
+}
+
+const resolved_license_t *license_store_t::find(std::string_view id) const
+{
+    const auto found = index.find(id);
+    return found == index.end() ? nullptr : &entries[found->second].license;
+}
+
+uint64_t license_store_t::generation() const
+{
+    return revocations ? std::max(current_generation, revocations->generation()) : current_generation;
+}
+
+uint64_t license_store_t::generation(std::string_view id) const
+{
+    const auto found = index.find(id);
+    const auto own = found == index.end() ? current_generation : entries[found->second].generation;
+    return revocations ? std::max(own, revocations->generation()) : own;
+}
+
+bool license_store_t::revoked(const resolved_license_t &license) const
+{
+    return revocations && revocations->revoked(license.secret);
+}
+
+void license_store_t::advance(const date::year_month_day &new_day, std::vector<status_change_t> &changes)
+{
+    changes.clear();
+    // A license is valid on a day up to and including its expiry, so those expiring from the earlier day up to the
+    // day before the later one are valid on the earlier day only
+    const auto moving_forward = day < new_day;
+    const auto from = expiries.lower_bound(date::sys_days{moving_forward ? day : new_day});
+    const auto to = expiries.lower_bound(date::sys_days{moving_forward ? new_day : day});
+    for (auto it = from; it != to; ++it)
+    {
+        const auto &entry = entries[it->second];
+        changes.push_back({entry.id, !moving_forward, entry.license.expiry});
+    }
+    day = new_day;
+}
+
+check_result_t license_store_t::check(std::string_view id,
+                                      std::string_view user,
+                                      std::string_view node,
+                                      const date::year_month_day &date) const
+{
+    const auto *license = find(id);
+    if (!license) return check_result_t::unknown_license;
+    return revoked(*license) ? check_result_t::revoked : license->check(user, node, date);
+}
+
+std::vector<loaded_license_t> load_licenses(const std::filesystem::path &directory,
+                                            const date::year_month_day &issue_date,
+                                            std::vector<std::string> &errors)
+{
+    std::vector<loaded_license_t> licenses;
+    std::vector<std::filesystem::path> files;
+    if (!std::filesystem::is_directory(directory) || !collect_license_files(directory, files))
+    {
+        errors.push_back(fmt::format("{}: cannot read directory", directory.string()));
+        return licenses;
+    }
+    const auto parser = prepare_parser();
+    if (!parser)
+    {
+        errors.push_back("license.peg: bad grammar");
+        return licenses;
+    }
+    std::string text;
+    for (const auto &file : files)
+    {
+        if (!read_file(file, text))
+        {
+            errors.push_back(fmt::format("{}: cannot read file", file.string()));
+            continue;
+        }
+        auto result = try_parse_license(*parser, issue_date, text, file.string());
+        if (!result.license)
+        {
+            const auto &problem = result.diagnostics.front();
+            errors.push_back(
+                fmt::format("{}:{}:{}: {}", file.string(), problem.line, problem.column, to_string(problem.code)));
+            continue;
+        }
+        auto id = std::filesystem::relative(file, directory).replace_extension().generic_string();
+        licenses.push_back({std::move(id), std::move(*result.license)});
+    }
+    return licenses;
+}
+
+license_store_t load_license_store(const std::filesystem::path &directory,
+                                   const date::year_month_day &issue_date,
+                                   std::vector<std::string> &errors)
+{
+    license_store_t store(issue_date);
+    for (auto &loaded : load_licenses(directory, issue_date, errors))
+        store.add(std::move(loaded.id), resolved_license_t(loaded.license, issue_date));
+    return store;
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include <fstream>
+#include <type_traits>
+
+TEST_CASE("resolved_license_t")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    const auto license = *parse_license(
+        issued, "secret=abc\nexpiry=2 weeks\nuser=stu\ndomain=example.com\nnode=build-*\nnetwork=10.1.0.0/16",
+        std::nullopt);
+    const auto resolved = resolved_license_t(license, issued);
+    REQUIRE(resolved.secret == "abc");
+    REQUIRE(resolved.expiry == 2019_y / 8 / 13);
+
+    REQUIRE(resolved.check("stu", "build-7", issued) == check_result_t::allowed);
+    REQUIRE(resolved.check("alice@eng.example.com", "10.1.2.3", 2019_y / 8 / 13) == check_result_t::allowed);
+    REQUIRE(resolved.check("stu", "build-7", 2019_y / 8 / 14) == check_result_t::expired);
+    REQUIRE(resolved.check("bob", "build-7", issued) == check_result_t::user_denied);
+    REQUIRE(resolved.check("stu", "cabbage", issued) == check_result_t::node_denied);
+    REQUIRE(resolved.check("stu", "10.2.0.1", issued) == check_result_t::node_denied);
+
+    const auto open = resolved_license_t(*parse_license(issued, "secret=abc\nexpiry=2019-01-01", std::nullopt), issued);
+    REQUIRE(open.check("anybody", "anywhere", 2019_y / 1 / 1) == check_result_t::allowed);
+    REQUIRE(open.check("anybody", "anywhere", issued) == check_result_t::expired);
+
+    // A tighter term does not bring back a license whose fixed date has passed
+    for (const auto *text :
+         {"secret=a\nexpiry=2019-01-01\nexpiry=1 month", "secret=a\nexpiry=1 month\nexpiry=2019-01-01"})
+    {
+        CAPTURE(text);
+        const auto tightened = resolved_license_t(*parse_license(issued, text, std::nullopt), issued);
+        REQUIRE(tightened.expiry == 2019_y / 1 / 1);
+        REQUIRE(tightened.check("anybody", "anywhere", issued) == check_result_t::expired);
+    }
+}
+
+static_assert(!std::is_copy_constructible_v<license_store_t> && std::is_move_constructible_v<license_store_t>);
+
+TEST_CASE("license_store_t")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    const auto directory = std::filesystem::temp_directory_path() / "license-check-test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "team");
+    std::ofstream(directory / "site.lic") << "secret=site\nanyone\nanywhere\n";
+    std::ofstream(directory / "team" / "build.lic") << "secret=build\nuser=stu\nnode=build-*\n";
+    std::ofstream(directory / "broken.lic") << "secret=broken\nexpiry=2019-02-30\n";
+    std::ofstream(directory / "notes.txt") << "not a license";
+
+    std::vector<std::string> errors;
+    auto store = load_license_store(directory, issued, errors);
+    REQUIRE(store.size() == 2);
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors.front().find("broken.lic:2:8: bad day") != std::string::npos);
+
+    REQUIRE(store.check("site", "anyone", "anything", issued) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "stu", "build-1", issued) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "bob", "build-1", issued) == check_result_t::user_denied);
+    REQUIRE(store.check("broken", "stu", "build-1", issued) == check_result_t::unknown_license);
+
+    const auto generation = store.generation();
+    REQUIRE(generation != license_store_t().generation());
+    const auto build_generation = store.generation("team/build");
+    const auto unknown_generation = store.generation("unknown");
+    store.add("site", resolved_license_t(*parse_license(issued, "secret=site\nuser=stu", std::nullopt), issued));
+    REQUIRE(store.size() == 2);
+    REQUIRE(store.generation() > generation);
+    REQUIRE(store.generation("site") == store.generation());
+    REQUIRE(store.generation("team/build") == build_generation);
+    REQUIRE(store.generation("unknown") > unknown_generation);
+
+    revocation_set_t revocations;
+    store.use_revocations(&revocations);
+    REQUIRE(store.check("team/build", "stu", "build-1", issued) == check_result_t::allowed);
+    const auto before = store.generation();
+    revocations.replace(revocation_list_t({revocation_hash("build")}));
+    REQUIRE(store.generation() > before);
+    REQUIRE(store.check("team/build", "stu", "build-1", issued) == check_result_t::revoked);
+    REQUIRE(store.check("team/build", "bob", "build-1", issued) == check_result_t::revoked);
+    REQUIRE(store.check("site", "stu", "anything", issued) == check_result_t::allowed);
+    REQUIRE(std::string_view(to_string(check_result_t::revoked)) == "revoked");
+    REQUIRE(store.check("site", "anyone", "anything", issued) == check_result_t::user_denied);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("license_store_t::advance")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    license_store_t store(issued);
+    const auto add = [&](const char *id, const char *text) {
+        store.add(id, resolved_license_t(*parse_license(issued, text, std::nullopt), issued));
+    };
+    add("past", "secret=a\nexpiry=2019-01-01");
+    add("today", "secret=b\nexpiry=2019-07-30");
+    add("week", "secret=c\nexpiry=1 week");
+    add("month", "secret=d\nexpiry=1 month");
+    add("forever", "secret=e");
+    add("renewed", "secret=f\nexpiry=2 days");
+    add("renewed", "secret=f\nexpiry=1 year");
+    REQUIRE(store.today() == issued);
+
+    std::vector<status_change_t> changes;
+    const auto changed = [&] {
+        std::vector<std::string> described;
+        for (const auto &change : changes)
+            described.push_back(fmt::format("{} {}", change.id, change.valid ? "valid" : "expired"));
+        std::sort(described.begin(), described.end());
+        return described;
+    };
+    store.advance(issued, changes);
+    REQUIRE(changes.empty());
+    store.advance(2019_y / 7 / 31, changes);
+    REQUIRE(changed() == std::vector<std::string>{"today expired"});
+    store.advance(2019_y / 8 / 6, changes);
+    REQUIRE(changes.empty());
+    store.advance(2019_y / 9 / 1, changes);
+    REQUIRE(changed() == std::vector<std::string>{"month expired", "week expired"});
+    for (const auto &change : changes)
+        REQUIRE(change.expiry == store.find(change.id)->expiry);
+
+    // Setting the clock back brings them back
+    store.advance(2019_y / 7 / 30, changes);
+    REQUIRE(changed() == std::vector<std::string>{"month valid", "today valid", "week valid"});
+    store.advance(2100_y / 1 / 1, changes);
+    REQUIRE(changed() == std::vector<std::string>{"month expired", "renewed expired", "today expired",
+                                                  "week expired"});
+    REQUIRE(store.today() == 2100_y / 1 / 1);
+
+    // A store made without a day starts from 1970
+    license_store_t fresh;
+    fresh.add("past", *store.find("past"));
+    fresh.advance(issued, changes);
+    REQUIRE(changed() == std::vector<std::string>{"past expired"});
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
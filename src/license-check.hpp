@@ -0,0 +1,137 @@
+#ifndef LICENSE_CHECK_HPP
+#define LICENSE_CHECK_HPP
+
+#include "license-identity.hpp"
+#include "license-location.hpp"
+#include "license.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class check_result_t : uint8_t
+{
+    allowed,
+    unknown_license,
+    expired,
+    user_denied,
+    node_denied,
+    revoked
+};
+
+constexpr size_t check_result_count = static_cast<size_t>(check_result_t::revoked) + 1;
+
+const char *to_string(check_result_t result);
+
+class revocation_set_t;
+
+// Each call returns a number greater than any before, for versions of license data that caches must tell apart
+uint64_t next_license_generation();
+
+// A license made ready to answer checks: its expiry resolved to a day, and its identity and location terms compiled
+// into matchers
+struct resolved_license_t
+{
+    resolved_license_t(const license_t &license, const date::year_month_day &issue_date);
+
+    // 'node' is a host name, or an IPv4 or IPv6 address to check against the license's networks
+    check_result_t check(std::string_view user, std::string_view node, const date::year_month_day &date) const;
+
+    std::string secret;
+    date::year_month_day expiry; // the last valid day
+    identity_matcher_t users;
+    location_matcher_t places;
+};
+
+// A license that became valid or expired when the day moved
+struct status_change_t
+{
+    std::string_view id;
+    bool valid; // on the new day
+    date::year_month_day expiry;
+};
+
+// Resolved licenses by ID
+class license_store_t
+{
+ public:
+    license_store_t() = default;
+    // 'today' is the day that advance first moves from - 1970-01-01 for a default store
+    explicit license_store_t(const date::year_month_day &today) : day(today) {}
+    // The index refers into the entries, so a copy would refer into the original. Moving keeps every element in place.
+    license_store_t(const license_store_t &) = delete;
+    license_store_t &operator=(const license_store_t &) = delete;
+    license_store_t(license_store_t &&) = default;
+    license_store_t &operator=(license_store_t &&) = default;
+
+    // Replaces any license with the same ID
+    void add(std::string id, resolved_license_t license);
+    const resolved_license_t *find(std::string_view id) const;
+    size_t size() const { return index.size(); }
+    // Changes whenever a license is added or replaced or the revocations are reloaded, and differs between stores, so
+    // that answers remembered from one generation are never given for another. Later generations are greater.
+    uint64_t generation() const;
+    // As for generation, but for the answers about one license: changes when that license is replaced or the
+    // revocations are reloaded, or for an unknown ID, when any license is added
+    uint64_t generation(std::string_view id) const;
+
+    // Licenses whose secrets are in 'revocations' are refused. The set must outlive the store; nullptr revokes
+    // nothing.
+    void use_revocations(const revocation_set_t *revocations) { this->revocations = revocations; }
+    bool revoked(const resolved_license_t &license) const;
+
+    date::year_month_day today() const { return day; }
+    // Moves the store to 'new_day', forwards or back, and lists the licenses valid on one day but not the other.
+    // Term lengths were counted from the issue date when the licenses were resolved, so only a license's expiry
+    // depends on the day: the licenses to look at are those with expiries between the two days, found in
+    // O(log n + k) rather than by checking every license.
+    void advance(const date::year_month_day &new_day, std::vector<status_change_t> &changes);
+
+    check_result_t check(std::string_view id,
+                         std::string_view user,
+                         std::string_view node,
+                         const date::year_month_day &date) const;
+
+ private:
+    using expiries_t = std::multimap<date::sys_days, size_t>;
+    struct entry_t
+    {
+        std::string id;
+        resolved_license_t license;
+        expiries_t::iterator expiry;
+        uint64_t generation;
+    };
+    // A deque never moves its elements, so the index can refer to the IDs they hold
+    std::deque<entry_t> entries;
+    std::unordered_map<std::string_view, size_t> index;
+    // Entries by the last day they are valid
+    expiries_t expiries;
+    date::year_month_day day = date::year_month_day{date::sys_days{}};
+    uint64_t current_generation = next_license_generation();
+    const revocation_set_t *revocations = nullptr;
+};
+
+struct loaded_license_t
+{
+    std::string id;
+    license_t license;
+};
+
+// Parses every '.lic' file under 'directory', with term lengths counted from 'issue_date'. A license's ID is its path
+// relative to 'directory', without the extension - eg 'team/build'. Files that do not parse are left out and
+// described in 'errors'.
+std::vector<loaded_license_t> load_licenses(const std::filesystem::path &directory,
+                                            const date::year_month_day &issue_date,
+                                            std::vector<std::string> &errors);
+
+// load_licenses, resolved into a store
+license_store_t load_license_store(const std::filesystem::path &directory,
+                                   const date::year_month_day &issue_date,
+                                   std::vector<std::string> &errors);
+
+#endif /* LICENSE_CHECK_HPP */
@@ -0,0 +1,287 @@
+#include "license-client.hpp"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <algorithm>
+
+#include <doctest/doctest.h>
+
+license_client_t::license_client_t(std::filesystem::path socket_path)
+    : license_client_t(std::move(socket_path), options_t{})
+{
+}
+
+license_client_t::license_client_t(std::filesystem::path socket_path, options_t options)
+    : socket_path(std::move(socket_path)), options(options)
+{
+}
+
+std::optional<check_result_t> license_client_t::check(std::string_view id,
+                                                      std::string_view user,
+                                                      std::string_view node,
+                                                      date::sys_days day)
+{
+    // Reused so that a hit allocates nothing
+    thread_local std::string key;
+    key.assign(id).append(1, '\0').append(user).append(1, '\0').append(node);
+    auto &shard = shards[std::hash<std::string>{}(key) % shards.size()];
+    const auto now = std::chrono::steady_clock::now();
+
+    std::unique_lock lock(shard.mutex);
+    if (const auto found = shard.answers.find(key); found != shard.answers.end() &&
+                                                    now - found->second.fetched < options.max_age &&
+                                                    check_response_holds(found->second.response, day))
+    {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return found->second.response.result;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+
+    if (const auto found = shard.pending.find(key); found != shard.pending.end())
+    {
+        const auto pending = found->second;
+        shard.answered.wait(lock, [&] { return pending->done; });
+        // An answer for another day may not hold for this one, in which case this thread asks for itself
+        if (pending->response && check_response_holds(*pending->response, day))
+        {
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+            return pending->response->result;
+        }
+    }
+
+    auto pending = std::make_shared<pending_t>();
+    const auto leading = shard.pending.emplace(key, pending).second;
+    lock.unlock();
+    const auto response = request({0, day, id, user, node});
+    lock.lock();
+
+    if (response)
+    {
+        const auto capacity = std::max<size_t>(1, options.cache_capacity / shards.size());
+        if (shard.answers.size() >= capacity && shard.answers.count(key) == 0)
+            shard.answers.erase(shard.answers.begin());
+        shard.answers[key] = {*response, now};
+    }
+    if (leading)
+    {
+        pending->done = true;
+        pending->response = response;
+        shard.pending.erase(key);
+        shard.answered.notify_all();
+    }
+    if (!response) return std::nullopt;
+    return response->result;
+}
+
+license_client_t::stats_t license_client_t::stats() const
+{
+    return {hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed),
+            coalesced.load(std::memory_order_relaxed), requests.load(std::memory_order_relaxed),
+            failures.load(std::memory_order_relaxed)};
+}
+
+std::optional<check_response_t> license_client_t::request(const check_request_t &query)
+{
+    const auto tag = next_tag.fetch_add(1, std::memory_order_relaxed);
+    auto tagged = query;
+    tagged.tag = tag;
+    std::string encoded;
+    if (!encode_check_request(tagged, encoded))
+    {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    requests.fetch_add(1, std::memory_order_relaxed);
+
+    // An idle connection may have been closed by a restarted daemon, so a failure on one is retried on a new one
+    for (;;)
+    {
+        auto fd = -1;
+        {
+            std::lock_guard lock(idle_mutex);
+            if (!idle.empty())
+            {
+                fd = idle.back();
+                idle.pop_back();
+            }
+        }
+        const auto reused = fd >= 0;
+        if (!reused) fd = connect_socket();
+        if (fd < 0) break;
+        if (const auto response = request_on(fd, encoded, tag))
+        {
+            release(fd);
+            return response;
+        }
+#if defined(__linux__)
+        close(fd);
+#endif
+        if (!reused) break;
+    }
+    failures.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+#if defined(__linux__)
+license_client_t::~license_client_t()
+{
+    for (const auto fd : idle)
+        close(fd);
+}
+
+std::optional<check_response_t> license_client_t::request_on(int fd, const std::string &encoded, uint32_t tag)
+{
+    for (size_t sent = 0; sent < encoded.size();)
+    {
+        const auto n = send(fd, encoded.data() + sent, encoded.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return std::nullopt;
+        sent += static_cast<size_t>(n);
+    }
+    char in[check_response_size];
+    for (size_t got = 0; got < sizeof(in);)
+    {
+        const auto n = read(fd, in + got, sizeof(in) - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return std::nullopt;
+        got += static_cast<size_t>(n);
+    }
+    check_response_t response;
+    size_t size = 0;
+    if (decode_check_response({in, sizeof(in)}, response, size) != decode_status_t::complete || response.tag != tag)
+        return std::nullopt;
+    return response;
+}
+
+int license_client_t::connect_socket() const
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.native().size() >= sizeof(address.sun_path)) return -1;
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.native().size());
+    const auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    // A daemon that stops answering fails the check rather than hanging it
+    const timeval timeout{1, 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void license_client_t::release(int fd)
+{
+    {
+        std::lock_guard lock(idle_mutex);
+        if (idle.size() < options.idle_connections)
+        {
+            idle.push_back(fd);
+            return;
+        }
+    }
+    close(fd);
+}
+#else
+license_client_t::~license_client_t() = default;
+
+std::optional<check_response_t> license_client_t::request_on(int, const std::string &, uint32_t)
+{
+    return std::nullopt;
+}
+
+int license_client_t::connect_socket() const
+{
+    return -1;
+}
+
+void license_client_t::release(int) {}
+#endif
+
+#if !defined(DOCTEST_CONFIG_DISABLE) && defined(__linux__)
+#include "license-parser.hpp"
+#include "license-server.hpp"
+
+#include <thread>
+
+TEST_CASE("license_client_t")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    const auto day = sys_days{issued};
+    license_store_t store;
+    store.add("build", resolved_license_t(*parse_license(issued, "secret=a\nexpiry=2 weeks\nuser=stu\nnode=build-*",
+                                                         std::nullopt),
+                                          issued));
+
+    const auto path = std::filesystem::temp_directory_path() / "license-client-test.sock";
+    license_server_t server(store);
+    REQUIRE(server.listen(path));
+    std::thread serving([&] { server.run(); });
+
+    SUBCASE("Answers are kept for as long as they hold")
+    {
+        license_client_t client(path);
+        REQUIRE(client.check("build", "stu", "build-1", day) == check_result_t::allowed);
+        REQUIRE(client.check("build", "stu", "build-1", day + days{14}) == check_result_t::allowed);
+        REQUIRE(client.stats().requests == 1);
+        REQUIRE(client.stats().hits == 1);
+
+        // The license expires after 2019-08-13, so the allowed answer no longer holds
+        REQUIRE(client.check("build", "stu", "build-1", day + days{15}) == check_result_t::expired);
+        REQUIRE(client.check("build", "stu", "build-1", day + days{400}) == check_result_t::expired);
+        REQUIRE(client.check("build", "bob", "build-1", day) == check_result_t::user_denied);
+        REQUIRE(client.check("other", "stu", "build-1", day) == check_result_t::unknown_license);
+        REQUIRE(client.check("other", "stu", "build-1", day + days{400}) == check_result_t::unknown_license);
+        const auto stats = client.stats();
+        REQUIRE(stats.requests == 4);
+        REQUIRE(stats.hits == 3);
+        REQUIRE(stats.misses == 4);
+        REQUIRE(stats.failures == 0);
+    }
+    SUBCASE("Answers older than max_age are asked for again")
+    {
+        license_client_t client(path, {1, 16, std::chrono::steady_clock::duration::zero()});
+        REQUIRE(client.check("build", "stu", "build-1", day) == check_result_t::allowed);
+        REQUIRE(client.check("build", "stu", "build-1", day) == check_result_t::allowed);
+        REQUIRE(client.stats().requests == 2);
+    }
+    SUBCASE("Concurrent checks share requests")
+    {
+        license_client_t client(path);
+        std::vector<std::thread> threads;
+        std::atomic<int> allowed{0};
+        for (int i = 0; i < 8; ++i)
+            threads.emplace_back([&] {
+                if (client.check("build", "stu", "build-1", day) == check_result_t::allowed) ++allowed;
+            });
+        for (auto &thread : threads)
+            thread.join();
+        REQUIRE(allowed == 8);
+        const auto stats = client.stats();
+        REQUIRE(stats.requests + stats.hits + stats.coalesced == 8);
+        REQUIRE(stats.failures == 0);
+    }
+
+    server.stop();
+    serving.join();
+
+    SUBCASE("Checks fail when there is no daemon")
+    {
+        license_client_t client(std::filesystem::temp_directory_path() / "license-client-missing.sock");
+        REQUIRE_FALSE(client.check("build", "stu", "build-1", day));
+        REQUIRE(client.stats().failures == 1);
+    }
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE) && defined(__linux__)
@@ -0,0 +1,98 @@
+#ifndef LICENSE_CLIENT_HPP
+#define LICENSE_CLIENT_HPP
+
+#include "license-check.hpp"
+#include "license-protocol.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Asks licensed (see license-server.hpp) for checks, and keeps each answer for as long as the license's resolved
+// expiry says it holds, so repeated checks never leave the process. Concurrent checks for the same license, user and
+// node share one request, and connections are kept open for reuse. Safe to use from any number of threads. Linux
+// only: elsewhere every check fails.
+class license_client_t
+{
+ public:
+    struct options_t
+    {
+        size_t idle_connections = 8; // connections kept open between checks
+        size_t cache_capacity = 65536;
+        // Bounds how long an answer is kept, so that a daemon reloading its licenses or its revocations is noticed. An
+        // 'allowed' answer cached before a license was revoked goes on being given for up to this long afterwards.
+        std::chrono::steady_clock::duration max_age = std::chrono::seconds(60);
+    };
+
+    struct stats_t
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t coalesced = 0; // misses answered by another thread's request
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+    };
+
+    explicit license_client_t(std::filesystem::path socket_path);
+    license_client_t(std::filesystem::path socket_path, options_t options);
+    license_client_t(const license_client_t &) = delete;
+    license_client_t &operator=(const license_client_t &) = delete;
+    ~license_client_t();
+
+    // Nothing if licensed could not be asked
+    std::optional<check_result_t> check(std::string_view id,
+                                        std::string_view user,
+                                        std::string_view node,
+                                        date::sys_days day);
+    stats_t stats() const;
+
+ private:
+    struct answer_t
+    {
+        check_response_t response;
+        std::chrono::steady_clock::time_point fetched;
+    };
+    struct pending_t
+    {
+        bool done = false;
+        std::optional<check_response_t> response;
+    };
+    struct shard_t
+    {
+        std::mutex mutex;
+        std::condition_variable answered;
+        std::unordered_map<std::string, answer_t> answers;
+        std::unordered_map<std::string, std::shared_ptr<pending_t>> pending;
+    };
+
+    std::optional<check_response_t> request(const check_request_t &query);
+    std::optional<check_response_t> request_on(int fd, const std::string &encoded, uint32_t tag);
+    int connect_socket() const;
+    void release(int fd);
+
+    const std::filesystem::path socket_path;
+    const options_t options;
+    std::array<shard_t, 16> shards;
+
+    std::mutex idle_mutex;
+    std::vector<int> idle;
+    std::atomic<uint32_t> next_tag{0};
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> failures{0};
+};
+
+#endif /* LICENSE_CLIENT_HPP */
@@ -0,0 +1,180 @@
+#include "license-decision.hpp"
+
+#include <algorithm>
+
+#include <doctest/doctest.h>
+
+decision_cache_t::decision_cache_t(size_t capacity) : shard_capacity(std::max<size_t>(1, capacity / 16)) {}
+
+check_result_t decision_cache_t::check(const license_store_t &store,
+                                       std::string_view id,
+                                       std::string_view user,
+                                       std::string_view node,
+                                       const date::year_month_day &day)
+{
+    // Reused so that a hit allocates nothing
+    thread_local std::string key;
+    const auto generation = store.generation(id);
+    const auto number = static_cast<int32_t>(date::sys_days{day}.time_since_epoch().count());
+    key.assign(reinterpret_cast<const char *>(&generation), sizeof(generation));
+    key.append(reinterpret_cast<const char *>(&number), sizeof(number));
+    key.append(id).append(1, '\0').append(user).append(1, '\0').append(node);
+    auto &shard = shards[std::hash<std::string>{}(key) % shards.size()];
+
+    {
+        std::lock_guard lock(shard.mutex);
+        if (const auto found = shard.index.find(key); found != shard.index.end())
+        {
+            auto &slot = shard.slots[found->second];
+            slot.referenced = true;
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return slot.result;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    const auto result = store.check(id, user, node, day);
+
+    std::lock_guard lock(shard.mutex);
+    // Another thread may have remembered the same decision while this one was checking
+    if (shard.index.count(key) != 0) return result;
+    if (shard.slots.size() < shard_capacity)
+    {
+        shard.index.emplace(key, static_cast<uint32_t>(shard.slots.size()));
+        shard.slots.push_back({key, result, false});
+        return result;
+    }
+    while (shard.slots[shard.hand].referenced)
+    {
+        shard.slots[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.slots.size();
+    }
+    auto &victim = shard.slots[shard.hand];
+    shard.index.erase(victim.key);
+    evictions.fetch_add(1, std::memory_order_relaxed);
+    victim.key = key;
+    victim.result = result;
+    shard.index.emplace(key, static_cast<uint32_t>(shard.hand));
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+    return result;
+}
+
+decision_cache_t::stats_t decision_cache_t::stats() const
+{
+    return {hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed),
+            evictions.load(std::memory_order_relaxed)};
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-parser.hpp"
+
+#include <thread>
+
+#include <fmt/core.h>
+
+namespace
+{
+void add_license(license_store_t &store, const char *id, const char *text, const date::year_month_day &issued)
+{
+    store.add(id, resolved_license_t(*parse_license(issued, text, std::nullopt), issued));
+}
+} // namespace
+
+TEST_CASE("decision_cache_t")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    license_store_t store;
+    add_license(store, "build", "secret=build\nexpiry=2 weeks\nuser=stu\nnode=build-*", issued);
+
+    decision_cache_t cache;
+    REQUIRE(cache.check(store, "build", "stu", "build-1", issued) == check_result_t::allowed);
+    REQUIRE(cache.check(store, "build", "stu", "build-1", issued) == check_result_t::allowed);
+    REQUIRE(cache.check(store, "build", "bob", "build-1", issued) == check_result_t::user_denied);
+    REQUIRE(cache.check(store, "other", "stu", "build-1", issued) == check_result_t::unknown_license);
+    REQUIRE(cache.check(store, "other", "stu", "build-1", issued) == check_result_t::unknown_license);
+    auto stats = cache.stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 3);
+
+    SUBCASE("Days are remembered side by side")
+    {
+        REQUIRE(cache.check(store, "build", "stu", "build-1", 2019_y / 8 / 14) == check_result_t::expired);
+        REQUIRE(cache.check(store, "build", "stu", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(cache.check(store, "build", "stu", "build-1", 2019_y / 8 / 14) == check_result_t::expired);
+        stats = cache.stats();
+        REQUIRE(stats.hits == 4);
+        REQUIRE(stats.misses == 4);
+    }
+
+    SUBCASE("Reloading a license forgets its decisions, and only its")
+    {
+        add_license(store, "site", "secret=site\nanyone\nanywhere", issued);
+        REQUIRE(cache.check(store, "build", "stu", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(cache.stats().hits == 3);
+        // 'other' was unknown, and adding any license might have been adding it
+        REQUIRE(cache.check(store, "other", "stu", "build-1", issued) == check_result_t::unknown_license);
+        REQUIRE(cache.stats().hits == 3);
+
+        add_license(store, "build", "secret=build\nuser=bob\nnode=build-*", issued);
+        REQUIRE(cache.check(store, "build", "stu", "build-1", issued) == check_result_t::user_denied);
+        REQUIRE(cache.check(store, "build", "bob", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(cache.check(store, "site", "stu", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(cache.stats().hits == 3);
+
+        // Two stores are remembered side by side too
+        license_store_t other;
+        add_license(other, "build", "secret=build\nuser=stu\nnode=build-*", issued);
+        REQUIRE(cache.check(other, "build", "bob", "build-1", issued) == check_result_t::user_denied);
+        REQUIRE(cache.check(store, "build", "bob", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(cache.check(other, "build", "bob", "build-1", issued) == check_result_t::user_denied);
+        REQUIRE(cache.stats().hits == 5);
+    }
+
+    SUBCASE("Full shards evict")
+    {
+        decision_cache_t small(16);
+        for (int round = 0; round < 2; ++round)
+        {
+            for (int i = 0; i < 1000; ++i)
+                REQUIRE(small.check(store, "build", fmt::format("user{}", i), "build-1", issued) ==
+                        check_result_t::user_denied);
+        }
+        stats = small.stats();
+        REQUIRE(stats.hits + stats.misses == 2000);
+        // One slot in each shard
+        REQUIRE(stats.evictions == stats.misses - 16);
+        REQUIRE(small.check(store, "build", "stu", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(small.check(store, "build", "stu", "build-1", issued) == check_result_t::allowed);
+        REQUIRE(small.stats().hits == stats.hits + 1);
+    }
+}
+
+TEST_CASE("decision_cache_t from many threads")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    license_store_t store;
+    add_license(store, "build", "secret=build\nuser=stu\nnode=build-*", issued);
+    decision_cache_t cache(64);
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 2000; ++i)
+            {
+                const auto user = i % 3 == 0 ? std::string("stu") : fmt::format("user{}", (i * (t + 1)) % 100);
+                const auto expected = user == "stu" ? check_result_t::allowed : check_result_t::user_denied;
+                const auto day = year_month_day{sys_days{issued} + days{i / 500}};
+                if (cache.check(store, "build", user, fmt::format("build-{}", i % 7), day) != expected) ++wrong;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    REQUIRE(wrong == 0);
+    const auto stats = cache.stats();
+    REQUIRE(stats.hits + stats.misses == 8000);
+    REQUIRE(stats.hits > 0);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
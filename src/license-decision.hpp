@@ -0,0 +1,64 @@
+#ifndef LICENSE_DECISION_HPP
+#define LICENSE_DECISION_HPP
+
+#include "license-check.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Remembers the decisions of license_store_t::check, for request paths that ask about the same few licenses, users
+// and nodes over and over. Decisions are keyed by the license's generation (see license_store_t::generation), its ID,
+// the user, node and day number, so one is never given for another store, a replaced license or another day, while
+// decisions for other licenses and other days stay put. Decisions that no longer match anything are never used again,
+// and so are the first to be evicted. Each of 16 shards has a fixed number of slots, reclaimed by CLOCK: a sweeping
+// hand evicts the first entry not used since the hand last passed it. Safe to use from any number of threads, as long
+// as the store is not changed while it is being checked.
+class decision_cache_t
+{
+ public:
+    struct stats_t
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    explicit decision_cache_t(size_t capacity = 65536);
+
+    check_result_t check(const license_store_t &store,
+                         std::string_view id,
+                         std::string_view user,
+                         std::string_view node,
+                         const date::year_month_day &day);
+    stats_t stats() const;
+
+ private:
+    struct slot_t
+    {
+        std::string key;
+        check_result_t result;
+        bool referenced;
+    };
+    struct shard_t
+    {
+        std::mutex mutex;
+        std::vector<slot_t> slots;
+        std::unordered_map<std::string, uint32_t> index;
+        size_t hand = 0;
+    };
+
+    const size_t shard_capacity;
+    std::array<shard_t, 16> shards;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+#endif /* LICENSE_DECISION_HPP */
@@ -0,0 +1,140 @@
+#include "license-decode.hpp"
+
+#include <charconv>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+// Decodes exactly N ASCII digits - the loop has a fixed trip count, so the compiler unrolls it
+template <size_t N>
+bool decode_digits(const char *text, uint16_t &value)
+{
+    unsigned result = 0;
+    bool ok = true;
+    for (size_t i = 0; i < N; ++i)
+    {
+        const auto digit = static_cast<unsigned>(static_cast<unsigned char>(text[i]) - '0');
+        ok &= digit < 10;
+        result = result * 10 + digit;
+    }
+    value = static_cast<uint16_t>(result);
+    return ok;
+}
+} // namespace
+
+const char *to_string(decode_error_t error)
+{
+    switch (error)
+    {
+    case decode_error_t::none:
+        return "no error";
+    case decode_error_t::bad_number:
+        return "bad number";
+    case decode_error_t::out_of_range:
+        return "number out of range";
+    case decode_error_t::bad_format:
+        return "bad date format";
+    case decode_error_t::bad_year:
+        return "bad year";
+    case decode_error_t::bad_month:
+        return "bad month";
+    case decode_error_t::bad_day:
+        return "bad day";
+    }
+    return "unknown error";
+}
+
+decode_error_t decode_natural(std::string_view text, uint16_t &value)
+{
+    const auto end = text.data() + text.size();
+    const auto [ptr, ec] = std::from_chars(text.data(), end, value);
+    if (ec == std::errc::result_out_of_range) return decode_error_t::out_of_range;
+    if (ec != std::errc{} || ptr != end) return decode_error_t::bad_number;
+    return decode_error_t::none;
+}
+
+decode_error_t decode_ymd(uint16_t year, uint16_t month, uint16_t day, date::year_month_day &ymd)
+{
+    const auto y = date::year{year};
+    if (!y.ok()) return decode_error_t::bad_year;
+    const auto ym = y / month;
+    if (!ym.ok()) return decode_error_t::bad_month;
+    const auto candidate = ym / day;
+    if (!candidate.ok()) return decode_error_t::bad_day;
+    ymd = candidate;
+    return decode_error_t::none;
+}
+
+decode_error_t decode_iso8601(std::string_view text, date::year_month_day &ymd)
+{
+    uint16_t year, month, day;
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') return decode_error_t::bad_format;
+    if (!decode_digits<4>(text.data(), year) || !decode_digits<2>(text.data() + 5, month) ||
+        !decode_digits<2>(text.data() + 8, day))
+    { return decode_error_t::bad_format; }
+    return decode_ymd(year, month, day, ymd);
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "test-allocations.hpp"
+
+TEST_CASE("decode_natural")
+{
+    uint16_t value = 0;
+    REQUIRE(decode_natural("0", value) == decode_error_t::none);
+    REQUIRE(value == 0);
+    REQUIRE(decode_natural("0042", value) == decode_error_t::none);
+    REQUIRE(value == 42);
+    REQUIRE(decode_natural("65535", value) == decode_error_t::none);
+    REQUIRE(value == 65535);
+    REQUIRE(decode_natural("65536", value) == decode_error_t::out_of_range);
+    REQUIRE(decode_natural("", value) == decode_error_t::bad_number);
+    REQUIRE(decode_natural("12 ", value) == decode_error_t::bad_number);
+    REQUIRE(decode_natural("-1", value) == decode_error_t::bad_number);
+    REQUIRE(decode_natural("x", value) == decode_error_t::bad_number);
+}
+
+TEST_CASE("decode_iso8601")
+{
+    using namespace date;
+    year_month_day ymd;
+    REQUIRE(decode_iso8601("2019-07-31", ymd) == decode_error_t::none);
+    REQUIRE(ymd == 2019_y / 7 / 31);
+    REQUIRE(decode_iso8601("2020-02-29", ymd) == decode_error_t::none);
+    REQUIRE(ymd == 2020_y / 2 / 29);
+    REQUIRE(decode_iso8601("2019-02-29", ymd) == decode_error_t::bad_day);
+    REQUIRE(decode_iso8601("2019-07-32", ymd) == decode_error_t::bad_day);
+    REQUIRE(decode_iso8601("2019-01-00", ymd) == decode_error_t::bad_day);
+    REQUIRE(decode_iso8601("2019-13-01", ymd) == decode_error_t::bad_month);
+    REQUIRE(decode_iso8601("2019-00-01", ymd) == decode_error_t::bad_month);
+    REQUIRE(decode_iso8601("20190-13-01", ymd) == decode_error_t::bad_format);
+    REQUIRE(decode_iso8601("2019-7-01", ymd) == decode_error_t::bad_format);
+    REQUIRE(decode_iso8601("2019-12-1", ymd) == decode_error_t::bad_format);
+    REQUIRE(decode_iso8601("2019/12/01", ymd) == decode_error_t::bad_format);
+    REQUIRE(decode_iso8601("2019-1a-01", ymd) == decode_error_t::bad_format);
+}
+
+TEST_CASE("decoding does not allocate")
+{
+    using namespace date;
+    uint16_t value = 0;
+    year_month_day ymd;
+    decode_error_t errors[5];
+    const allocation_counter_t counter;
+    errors[0] = decode_natural("1234", value);
+    errors[1] = decode_natural("99999", value);
+    errors[2] = decode_iso8601("2019-07-31", ymd);
+    errors[3] = decode_iso8601("2019-07-32", ymd);
+    errors[4] = decode_ymd(2019, 13, 1, ymd);
+    const auto counts = counter.counts();
+
+    REQUIRE(counts.allocations == 0);
+    REQUIRE(counts.bytes == 0);
+    REQUIRE(errors[0] == decode_error_t::none);
+    REQUIRE(errors[1] == decode_error_t::out_of_range);
+    REQUIRE(errors[2] == decode_error_t::none);
+    REQUIRE(errors[3] == decode_error_t::bad_day);
+    REQUIRE(errors[4] == decode_error_t::bad_month);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
@@ -0,0 +1,32 @@
+#ifndef LICENSE_DECODE_HPP
+#define LICENSE_DECODE_HPP
+
+#include <cstdint>
+#include <string_view>
+
+#include <date/date.h>
+
+// Numeric and date token decoding that never allocates or throws - failures are reported as an error code, in the
+// style of std::from_chars
+enum class decode_error_t : uint8_t
+{
+    none = 0,
+    bad_number,
+    out_of_range,
+    bad_format,
+    bad_year,
+    bad_month,
+    bad_day
+};
+
+const char *to_string(decode_error_t error);
+
+// Decodes all of 'text' as a decimal number
+decode_error_t decode_natural(std::string_view text, uint16_t &value);
+
+decode_error_t decode_ymd(uint16_t year, uint16_t month, uint16_t day, date::year_month_day &ymd);
+
+// Decodes exactly 'YYYY-MM-DD'
+decode_error_t decode_iso8601(std::string_view text, date::year_month_day &ymd);
+
+#endif /* LICENSE_DECODE_HPP */
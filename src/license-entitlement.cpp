@@ -0,0 +1,259 @@
+#include "license-entitlement.hpp"
+
+#include "ascii.hpp"
+#include "license-network.hpp"
+#include "overloaded.hpp"
+
+#include <algorithm>
+#include <optional>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+using postings_t = std::vector<uint32_t>;
+
+void post(postings_t &postings, uint32_t license)
+{
+    // Licenses are added in order, so appending keeps every list sorted; a license naming a key twice is filed once
+    if (postings.empty() || postings.back() != license) postings.push_back(license);
+}
+
+void lower_into(std::string_view text, std::string &lowered)
+{
+    lowered.assign(text);
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(), to_lower_ascii);
+}
+
+// As for identity_matcher_t, 'example.com.' is the same domain as 'example.com'
+std::string_view trim_domain(std::string_view domain)
+{
+    while (!domain.empty() && domain.back() == '.')
+        domain.remove_suffix(1);
+    return domain;
+}
+
+// The posting lists one side of a query could match
+struct side_t
+{
+    std::vector<const postings_t *> lists;
+    size_t total = 0;
+
+    void clear()
+    {
+        lists.clear();
+        total = 0;
+    }
+    void add(const postings_t *postings)
+    {
+        if (!postings || postings->empty()) return;
+        lists.push_back(postings);
+        total += postings->size();
+    }
+    bool contains(uint32_t license) const
+    {
+        return std::any_of(lists.begin(), lists.end(), [&](const postings_t *postings) {
+            return std::binary_search(postings->begin(), postings->end(), license);
+        });
+    }
+};
+
+template <class Map>
+const postings_t *lookup(const Map &map, const std::string &key)
+{
+    const auto found = map.find(key);
+    return found == map.end() ? nullptr : &found->second;
+}
+} // namespace
+
+uint32_t entitlement_index_t::add(std::string id, const license_t &license, const date::year_month_day &issue_date)
+{
+    const auto number = static_cast<uint32_t>(ids.size());
+    ids.push_back(std::move(id));
+    expiries.push_back(date::sys_days{resolve_expiry(issue_date, license)});
+
+    std::string key;
+    // As for identity_matcher_t, a license naming no user or domain allows anyone
+    bool names_someone = false;
+    for (const auto &identity : license.allowed_users)
+    {
+        std::visit(overloaded{[&](const anyone_t &) { post(anyone, number); },
+                              [&](const user_t &user) {
+                                  post(users[user.get()], number);
+                                  names_someone = true;
+                              },
+                              [&](const domain_t &domain) {
+                                  // A domain with no labels names someone, but matches nobody
+                                  names_someone = true;
+                                  lower_into(trim_domain(domain.get()), key);
+                                  if (key.empty()) return;
+                                  post(domains[key], number);
+                              }},
+                   identity);
+    }
+    if (!names_someone) post(anyone, number);
+
+    bool is_inexact = false;
+    if (license.allowed_places.empty()) post(anywhere, number);
+    for (const auto &location : license.allowed_places)
+    {
+        std::visit(overloaded{[&](const anywhere_t &) { post(anywhere, number); },
+                              [&](const node_t &node) {
+                                  lower_into(node.get(), key);
+                                  post(nodes[key], number);
+                              },
+                              [&](const node_pattern_t &) { is_inexact = true; },
+                              [&](const network_t &) { is_inexact = true; }},
+                   location);
+    }
+    if (is_inexact)
+    {
+        post(inexact, number);
+        inexact_places.emplace(number, location_matcher_t(license.allowed_places));
+    }
+    return number;
+}
+
+bool entitlement_index_t::grants(std::string_view user, std::string_view node, const date::year_month_day &day) const
+{
+    thread_local std::vector<uint32_t> found;
+    find(user, node, date::sys_days{day}, 1, found);
+    return !found.empty();
+}
+
+void entitlement_index_t::find_grants(std::string_view user,
+                                      std::string_view node,
+                                      const date::year_month_day &day,
+                                      std::vector<uint32_t> &licenses) const
+{
+    find(user, node, date::sys_days{day}, ids.size(), licenses);
+}
+
+void entitlement_index_t::find(std::string_view user,
+                               std::string_view node,
+                               date::sys_days day,
+                               size_t limit,
+                               std::vector<uint32_t> &found) const
+{
+    // Reused between queries, so a query allocates nothing once they have grown
+    thread_local std::string key;
+    thread_local std::string suffix;
+    thread_local side_t user_side;
+    thread_local side_t node_side;
+    thread_local std::vector<uint32_t> candidates;
+    found.clear();
+
+    user_side.clear();
+    key.assign(user);
+    user_side.add(lookup(users, key));
+    if (const auto at = user.rfind('@'); at != std::string_view::npos)
+    {
+        // 'alice@eng.example.com' is in 'eng.example.com', 'example.com' and 'com'
+        lower_into(trim_domain(user.substr(at + 1)), key);
+        for (size_t label = 0; label < key.size();)
+        {
+            suffix.assign(key, label);
+            user_side.add(lookup(domains, suffix));
+            const auto dot = key.find('.', label);
+            label = dot == std::string::npos ? key.size() : dot + 1;
+        }
+    }
+    user_side.add(&anyone);
+
+    node_side.clear();
+    lower_into(node, key);
+    const auto *named = lookup(nodes, key);
+    node_side.add(named);
+    node_side.add(&anywhere);
+    node_side.add(&inexact);
+
+    candidates.clear();
+    const auto &shorter = user_side.total <= node_side.total ? user_side : node_side;
+    for (const auto *postings : shorter.lists)
+        candidates.insert(candidates.end(), postings->begin(), postings->end());
+    if (shorter.lists.size() > 1)
+    {
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    std::optional<std::optional<ip_address_t>> address;
+    const auto node_allowed = [&](uint32_t license) {
+        if (named && std::binary_search(named->begin(), named->end(), license)) return true;
+        if (std::binary_search(anywhere.begin(), anywhere.end(), license)) return true;
+        const auto matcher = inexact_places.find(license);
+        if (matcher == inexact_places.end()) return false;
+        if (matcher->second.matches_node(node)) return true;
+        if (!address) address = parse_ip_address(node);
+        return *address && matcher->second.matches_address(**address);
+    };
+    for (const auto license : candidates)
+    {
+        if (expiries[license] < day || !user_side.contains(license) || !node_allowed(license)) continue;
+        found.push_back(license);
+        if (found.size() == limit) return;
+    }
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-check.hpp"
+#include "license-parser.hpp"
+
+TEST_CASE("entitlement_index_t")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    const char *texts[] = {
+        "secret=a\nuser=stu\nnode=build-1",
+        "secret=b\ndomain=Example.COM\nanywhere",
+        "secret=c\nanyone\nnode=build-*\nexpiry=2 weeks",
+        "secret=d\nuser=alice@eng.example.com\nnetwork=10.0.0.0/8",
+        "secret=e\nexpiry=2019-01-01",
+        "secret=f\nuser=bob\ndomain=eng.example.com\nnode=BUILD-2\nnode=release\nnode=build-2",
+        "secret=g",
+        "secret=h\ndomain=.",
+        "secret=i\nexpiry=2019-01-01\nexpiry=1 month",
+    };
+    entitlement_index_t index;
+    std::vector<resolved_license_t> resolved;
+    for (const auto *text : texts)
+    {
+        const auto license = *parse_license(issued, text, std::nullopt);
+        index.add(license.secret, license, issued);
+        resolved.emplace_back(license, issued);
+    }
+    REQUIRE(index.size() == 9);
+    REQUIRE(index.id(3) == "d");
+
+    // The index must agree with checking every license in turn
+    const char *users[] = {"stu", "Stu", "bob", "alice@eng.example.com", "carol@EXAMPLE.com", "dave@other.org",
+                           "erin@notexample.com"};
+    const char *nodes[] = {"build-1", "BUILD-2", "build-9", "release", "10.1.2.3", "11.0.0.1", "cabbage"};
+    const year_month_day days[] = {2018_y / 12 / 31, issued, 2019_y / 8 / 13, 2019_y / 8 / 14};
+    std::vector<uint32_t> found;
+    for (const auto *user : users)
+    {
+        for (const auto *node : nodes)
+        {
+            for (const auto &day : days)
+            {
+                CAPTURE(user);
+                CAPTURE(node);
+                CAPTURE(day);
+                std::vector<uint32_t> expected;
+                for (uint32_t i = 0; i < resolved.size(); ++i)
+                {
+                    if (resolved[i].check(user, node, day) == check_result_t::allowed) expected.push_back(i);
+                }
+                index.find_grants(user, node, day, found);
+                REQUIRE(found == expected);
+                REQUIRE(index.grants(user, node, day) == !expected.empty());
+            }
+        }
+    }
+
+    // Only the license with no terms grants a stranger anything: 'i' expired before the term length could matter
+    index.find_grants("nobody", "nowhere", 2019_y / 8 / 14, found);
+    REQUIRE(found == std::vector<uint32_t>{6});
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
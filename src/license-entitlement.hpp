@@ -0,0 +1,60 @@
+#ifndef LICENSE_ENTITLEMENT_HPP
+#define LICENSE_ENTITLEMENT_HPP
+
+#include "license-location.hpp"
+#include "license.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Answers "does any license valid today grant this user on this node?" across many licenses, without scanning them.
+// Each license is filed in posting lists - sorted license numbers - under every user, domain and node name it names,
+// or in the ANYONE and ANYWHERE lists. A query gathers the lists its user could match and the lists its node could
+// match, walks whichever side is shorter, and keeps the licenses that are on the other side too and unexpired, so it
+// costs the size of the shorter side rather than the size of the store.
+//
+// Node patterns and networks cannot be looked up by name, so licenses with any are also filed in one list whose
+// members are checked against their compiled location matcher.
+class entitlement_index_t
+{
+ public:
+    // Licenses are numbered from 0 in the order they are added. Term lengths count from 'issue_date'.
+    uint32_t add(std::string id, const license_t &license, const date::year_month_day &issue_date);
+
+    size_t size() const { return ids.size(); }
+    const std::string &id(uint32_t license) const { return ids[license]; }
+
+    // 'user' and 'node' are as for resolved_license_t::check
+    bool grants(std::string_view user, std::string_view node, const date::year_month_day &day) const;
+    // Every license that grants, in the order they were added
+    void find_grants(std::string_view user,
+                     std::string_view node,
+                     const date::year_month_day &day,
+                     std::vector<uint32_t> &licenses) const;
+
+ private:
+    using postings_t = std::vector<uint32_t>;
+
+    // Stops early, once 'found' has 'limit' licenses
+    void find(std::string_view user,
+              std::string_view node,
+              date::sys_days day,
+              size_t limit,
+              std::vector<uint32_t> &found) const;
+
+    std::vector<std::string> ids;
+    std::vector<date::sys_days> expiries;
+    std::unordered_map<std::string, postings_t> users;
+    // Keys are lower case, without a trailing dot
+    std::unordered_map<std::string, postings_t> domains;
+    std::unordered_map<std::string, postings_t> nodes;
+    postings_t anyone;
+    postings_t anywhere;
+    postings_t inexact;
+    std::unordered_map<uint32_t, location_matcher_t> inexact_places;
+};
+
+#endif /* LICENSE_ENTITLEMENT_HPP */
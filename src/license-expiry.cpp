@@ -0,0 +1,209 @@
+#include "license-expiry.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+constexpr int32_t expired_timer = -1;
+
+const auto never = date::sys_days{date::year::max() / 12 / 31};
+} // namespace
+
+expiry_scheduler_t::expiry_scheduler_t(date::sys_days today, std::vector<int> warnings)
+    : origin(today), warnings(std::move(warnings))
+{
+}
+
+void expiry_scheduler_t::schedule(std::string id, date::sys_days expiry)
+{
+    auto found = index.find(id);
+    if (found == index.end())
+    {
+        licenses.push_back({std::move(id), expiry});
+        found = index.emplace(licenses.back().id, static_cast<uint32_t>(licenses.size() - 1)).first;
+    }
+    auto &entry = licenses[found->second];
+    ++entry.generation;
+    entry.expiry = expiry;
+    if (!entry.active) ++scheduled;
+    entry.active = true;
+    if (expiry == never) return;
+
+    auto add = [&](date::sys_days due, int32_t days_left) {
+        const auto offset = (due - origin).count();
+        const timer_t timer{found->second, entry.generation, static_cast<uint32_t>(std::max<int64_t>(offset, 0)),
+                            days_left};
+        if (offset <= static_cast<int64_t>(now))
+            overdue.push_back(timer);
+        else
+            file(timer);
+    };
+    for (const auto days_left : warnings)
+    {
+        const auto due = expiry - date::days{days_left};
+        if (due >= today()) add(due, days_left);
+    }
+    add(expiry + date::days{1}, expired_timer);
+}
+
+void expiry_scheduler_t::cancel(std::string_view id)
+{
+    const auto found = index.find(id);
+    if (found == index.end() || !licenses[found->second].active) return;
+    auto &entry = licenses[found->second];
+    // Its timers stay filed, and are dropped when they come due
+    ++entry.generation;
+    entry.active = false;
+    --scheduled;
+}
+
+void expiry_scheduler_t::file(const timer_t &timer)
+{
+    const auto delta = timer.due - now;
+    for (size_t level = 0; level < wheel_levels; ++level)
+    {
+        if (delta < (uint64_t{1} << (wheel_bits * (level + 1))))
+        {
+            wheel[level][(timer.due >> (wheel_bits * level)) & (wheel_slots - 1)].push_back(timer);
+            return;
+        }
+    }
+    distant.push_back(timer);
+}
+
+// The timer's own day may have been clamped to 'origin', but the license's expiry gives the real one
+date::sys_days expiry_scheduler_t::due_day(const timer_t &timer) const
+{
+    const auto expiry = licenses[timer.license].expiry;
+    return timer.days_left == expired_timer ? expiry + date::days{1} : expiry - date::days{timer.days_left};
+}
+
+void expiry_scheduler_t::raise_timer(const timer_t &timer,
+                                     const std::function<void(const expiry_event_t &)> &raise) const
+{
+    const auto &entry = licenses[timer.license];
+    if (!entry.active || entry.generation != timer.generation) return;
+    const auto expired = timer.days_left == expired_timer;
+    raise({entry.id, expired ? expiry_event_kind_t::expired : expiry_event_kind_t::expiring,
+           expired ? 0 : timer.days_left, entry.expiry, due_day(timer)});
+}
+
+void expiry_scheduler_t::advance(date::sys_days day, const std::function<void(const expiry_event_t &)> &raise)
+{
+    std::stable_sort(overdue.begin(), overdue.end(),
+                     [&](const auto &l, const auto &r) { return due_day(l) < due_day(r); });
+    for (const auto &timer : std::exchange(overdue, {}))
+        raise_timer(timer, raise);
+
+    std::vector<timer_t> taken;
+    const auto cascade = [&](std::vector<timer_t> &slot) {
+        taken.swap(slot);
+        for (const auto &timer : taken)
+            file(timer);
+        taken.clear();
+    };
+    while (today() < day)
+    {
+        ++now;
+        // Each level's slot for the span now starting moves down before the day's events are raised
+        if (now % (wheel_slots * wheel_slots * wheel_slots) == 0) cascade(distant);
+        for (auto level = wheel_levels - 1; level > 0; --level)
+        {
+            if (now % (uint64_t{1} << (wheel_bits * level)) == 0)
+                cascade(wheel[level][(now >> (wheel_bits * level)) & (wheel_slots - 1)]);
+        }
+        taken.swap(wheel[0][now & (wheel_slots - 1)]);
+        for (const auto &timer : taken)
+            raise_timer(timer, raise);
+        taken.clear();
+    }
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include <random>
+
+#include <fmt/core.h>
+
+TEST_CASE("expiry_scheduler_t")
+{
+    using namespace date;
+    const auto today = sys_days{2019_y / 7 / 30};
+    expiry_scheduler_t scheduler(today, {7, 1});
+    std::vector<std::string> events;
+    const auto record = [&](const expiry_event_t &event) {
+        events.push_back(fmt::format("{} {} {} {}", (event.due - today).count(), event.id,
+                                     event.kind == expiry_event_kind_t::expired ? "expired" : "expiring",
+                                     event.days_left));
+    };
+
+    scheduler.schedule("soon", today + days{10});
+    scheduler.schedule("later", today + days{100});
+    scheduler.schedule("much-later", today + days{5000});
+    scheduler.schedule("gone", today - days{1});
+    scheduler.schedule("long-gone", today - days{10});
+    scheduler.schedule("forever", sys_days{year::max() / 12 / 31});
+    scheduler.schedule("cancelled", today + days{3});
+    scheduler.schedule("renewed", today + days{20});
+    scheduler.schedule("close", today + days{3});
+    scheduler.cancel("cancelled");
+    scheduler.schedule("renewed", today + days{30});
+    REQUIRE(scheduler.size() == 8);
+
+    // Overdue events are raised in the order of the days they were for
+    scheduler.advance(today + days{2}, record);
+    REQUIRE(events == std::vector<std::string>{"-9 long-gone expired 0", "0 gone expired 0", "2 close expiring 1"});
+    events.clear();
+    scheduler.advance(today + days{11}, record);
+    REQUIRE(events == std::vector<std::string>{"3 soon expiring 7", "4 close expired 0", "9 soon expiring 1",
+                                               "11 soon expired 0"});
+    events.clear();
+    scheduler.advance(today + days{6000}, record);
+    REQUIRE(events == std::vector<std::string>{"23 renewed expiring 7", "29 renewed expiring 1",
+                                               "31 renewed expired 0", "93 later expiring 7", "99 later expiring 1",
+                                               "101 later expired 0", "4993 much-later expiring 7",
+                                               "4999 much-later expiring 1", "5001 much-later expired 0"});
+    REQUIRE(scheduler.today() == today + days{6000});
+}
+
+TEST_CASE("expiry_scheduler_t agrees with a sorted list")
+{
+    using namespace date;
+    const auto today = sys_days{2019_y / 7 / 30};
+    expiry_scheduler_t scheduler(today, {30, 7, 1});
+    std::mt19937 random(42);
+    // Due day and event
+    std::vector<std::pair<int, std::string>> expected;
+    for (int i = 0; i < 2000; ++i)
+    {
+        const auto expiry = static_cast<int>(random() % 400000);
+        const auto id = std::to_string(i);
+        scheduler.schedule(id, today + days{expiry});
+        for (const auto days_left : {30, 7, 1})
+        {
+            if (expiry - days_left >= 0) expected.emplace_back(expiry - days_left, id + " expiring");
+        }
+        expected.emplace_back(expiry + 1, id + " expired");
+    }
+
+    std::vector<std::pair<int, std::string>> raised;
+    auto day = 0;
+    while (day < 410000)
+    {
+        const auto previous = day;
+        day += static_cast<int>(random() % 5000);
+        scheduler.advance(today + days{day}, [&](const expiry_event_t &event) {
+            const auto due = static_cast<int>((event.due - today).count());
+            REQUIRE((due > previous || due == 0));
+            REQUIRE(due <= day);
+            raised.emplace_back(due, fmt::format("{} {}", event.id,
+                                                 event.kind == expiry_event_kind_t::expired ? "expired" : "expiring"));
+        });
+    }
+    std::sort(expected.begin(), expected.end());
+    std::sort(raised.begin(), raised.end());
+    REQUIRE(raised == expected);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
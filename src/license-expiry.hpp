@@ -0,0 +1,88 @@
+#ifndef LICENSE_EXPIRY_HPP
+#define LICENSE_EXPIRY_HPP
+
+#include "license.hpp"
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class expiry_event_kind_t : uint8_t
+{
+    expiring, // 'days_left' days before the license's last valid day
+    expired   // the day after its last valid day
+};
+
+struct expiry_event_t
+{
+    std::string_view id;
+    expiry_event_kind_t kind;
+    int days_left;
+    date::sys_days expiry; // the last valid day
+    date::sys_days due;    // the day the event is for, which is earlier than the day it is raised if it was overdue
+};
+
+// Raises "expiring in N days" and "expired" events for licenses as the days go by, rather than checking every license
+// every day. Events are filed in a hierarchical timer wheel of days - 64 days, then 64 spans of 64 days, then 64
+// spans of 4096 days - so scheduling is O(1), an event moves down a level at most twice before it fires, and
+// advancing costs one step per day whatever the number of licenses. Licenses that never expire raise nothing.
+class expiry_scheduler_t
+{
+ public:
+    // 'warnings' are the numbers of days before expiry at which to raise 'expiring' events
+    explicit expiry_scheduler_t(date::sys_days today, std::vector<int> warnings = {30, 7, 1});
+
+    // Replaces the license's events, if it has any. Warnings whose day has passed are skipped, but a license that has
+    // already expired raises 'expired' on the next advance.
+    void schedule(std::string id, date::sys_days expiry);
+    void cancel(std::string_view id);
+    size_t size() const { return scheduled; }
+
+    date::sys_days today() const { return origin + date::days{static_cast<int>(now)}; }
+    // Raises every event due up to and including 'day', in day order. 'raise' may schedule and cancel licenses.
+    void advance(date::sys_days day, const std::function<void(const expiry_event_t &)> &raise);
+
+ private:
+    struct timer_t
+    {
+        uint32_t license;
+        uint32_t generation;
+        uint32_t due; // days since 'origin', or 0 if earlier
+        int32_t days_left;
+    };
+    struct license_entry_t
+    {
+        std::string id;
+        date::sys_days expiry;
+        uint32_t generation = 0;
+        bool active = false;
+    };
+
+    static constexpr size_t wheel_bits = 6;
+    static constexpr size_t wheel_slots = size_t{1} << wheel_bits;
+    static constexpr size_t wheel_levels = 3;
+
+    void file(const timer_t &timer);
+    date::sys_days due_day(const timer_t &timer) const;
+    void raise_timer(const timer_t &timer, const std::function<void(const expiry_event_t &)> &raise) const;
+
+    const date::sys_days origin;
+    const std::vector<int> warnings;
+    uint64_t now = 0;
+    // A deque never moves its elements, so the index can refer to the IDs they hold
+    std::deque<license_entry_t> licenses;
+    std::unordered_map<std::string_view, uint32_t> index;
+    size_t scheduled = 0;
+    std::array<std::array<std::vector<timer_t>, wheel_slots>, wheel_levels> wheel;
+    // Events due by 'now' when they were scheduled, raised on the next advance
+    std::vector<timer_t> overdue;
+    // Events too far off for the wheel
+    std::vector<timer_t> distant;
+};
+
+#endif /* LICENSE_EXPIRY_HPP */
@@ -0,0 +1,31 @@
+#include "license-files.hpp"
+
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+bool read_file(const fs::path &path, std::string &buffer)
+{
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if (ec) return false;
+    buffer.resize(size);
+    auto in = std::ifstream(path, std::ios::in | std::ios::binary);
+    return in && in.read(buffer.data(), static_cast<std::streamsize>(size));
+}
+
+bool collect_license_files(const fs::path &path, std::vector<fs::path> &files)
+{
+    std::error_code ec;
+    if (!fs::is_directory(path, ec))
+    {
+        files.push_back(path);
+        return true;
+    }
+    for (auto i = fs::recursive_directory_iterator(path, ec); !ec && i != fs::recursive_directory_iterator();
+         i.increment(ec))
+    {
+        if (i->is_regular_file(ec) && i->path().extension() == ".lic") files.push_back(i->path());
+    }
+    return !ec;
+}
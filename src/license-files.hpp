@@ -0,0 +1,14 @@
+#ifndef LICENSE_FILES_HPP
+#define LICENSE_FILES_HPP
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Reads into a buffer the caller reuses, so reading a file only allocates when it is the largest seen yet
+bool read_file(const std::filesystem::path &path, std::string &buffer);
+
+// Named files are always collected; directories are searched recursively for '.lic' files
+bool collect_license_files(const std::filesystem::path &path, std::vector<std::filesystem::path> &files);
+
+#endif /* LICENSE_FILES_HPP */
@@ -1,6 +1,8 @@
 #ifndef LICENSE_FORMATTERS_HPP
 #define LICENSE_FORMATTERS_HPP
 
+#include "license-network.hpp"
+#include "license-parser.hpp"
 #include "license.hpp"
 
 #include <ostream>
@@ -11,14 +13,14 @@
 namespace std
 {
 template <class T>
-std::ostream &operator<<(std::ostream &os, const vector<T> &value)
+inline std::ostream &operator<<(std::ostream &os, const vector<T> &value)
 {
     os << "[ ";
     for (const auto &i : value)
         os << i << (&i == &value.back() ? "" : ", ");
     return os << " ]";
 }
-std::ostream &operator<<(std::ostream &os, const expiry_t &value)
+inline std::ostream &operator<<(std::ostream &os, const expiry_t &value)
 {
     return std::visit(overloaded{[&](const perpetual_t &) -> std::ostream & { return os << "Expiry{Perpetual}"; },
                                  [&](const term_length_t &t) -> std::ostream & {
@@ -37,17 +39,23 @@ std::ostream &operator<<(std::ostream &os, const expiry_t &value)
                                  }},
                       value);
 }
-std::ostream &operator<<(std::ostream &os, const location_t &value)
+inline std::ostream &operator<<(std::ostream &os, const location_t &value)
 {
     return std::visit(overloaded{[&](const anywhere_t &) -> std::ostream & {
                                      return os << fmt::format("Location{{Anywhere}}");
                                  },
                                  [&](const node_t &t) -> std::ostream & {
                                      return os << fmt::format("Location{{Node {}}}", t.get());
+                                 },
+                                 [&](const node_pattern_t &t) -> std::ostream & {
+                                     return os << fmt::format("Location{{Node pattern {}}}", t.get());
+                                 },
+                                 [&](const network_t &t) -> std::ostream & {
+                                     return os << fmt::format("Location{{Network {}}}", to_string(t));
                                  }},
                       value);
 }
-std::ostream &operator<<(std::ostream &os, const identity_t &value)
+inline std::ostream &operator<<(std::ostream &os, const identity_t &value)
 {
     return std::visit(overloaded{[&](const anyone_t &) -> std::ostream & {
                                      return os << fmt::format("Identity{{Anyone}}");
@@ -60,6 +68,10 @@ std::ostream &operator<<(std::ostream &os, const identity_t &value)
                                  }},
                       value);
 }
+inline std::ostream &operator<<(std::ostream &os, const diagnostic_t &value)
+{
+    return os << fmt::format("{}:{}: {}", value.line, value.column, to_string(value.code));
+}
 } // namespace std
 
 #endif /* LICENSE_FORMATTERS_HPP */
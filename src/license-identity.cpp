@@ -0,0 +1,173 @@
+#include "license-identity.hpp"
+
+#include "ascii.hpp"
+#include "overloaded.hpp"
+
+#include <algorithm>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+// Domains are compared case-insensitively, and 'example.com.' is the same domain as 'example.com'
+std::string_view trim_domain(std::string_view domain)
+{
+    while (!domain.empty() && domain.back() == '.')
+        domain.remove_suffix(1);
+    return domain;
+}
+
+// Removes and returns the right-most label of 'domain'
+std::string_view pop_label(std::string_view &domain)
+{
+    const auto dot = domain.rfind('.');
+    const auto label = (dot == std::string_view::npos) ? domain : domain.substr(dot + 1);
+    domain = (dot == std::string_view::npos) ? std::string_view{} : domain.substr(0, dot);
+    return label;
+}
+
+bool label_less(std::string_view l, std::string_view r)
+{
+    return std::lexicographical_compare(l.begin(), l.end(), r.begin(), r.end(), [](char a, char b) {
+        return to_lower_ascii(a) < to_lower_ascii(b);
+    });
+}
+} // namespace
+
+identity_matcher_t::identity_matcher_t(const std::vector<identity_t> &identities)
+{
+    for (const auto &id : identities)
+        add(id);
+}
+
+void identity_matcher_t::add(const identity_t &id)
+{
+    std::visit(overloaded{[&](const anyone_t &) { anyone = true; },
+                          [&](const user_t &u) {
+                              users.insert(u.get());
+                              named = true;
+                          },
+                          [&](const domain_t &d) { add_domain(d.get()); }},
+               id);
+}
+
+void identity_matcher_t::add_domain(std::string_view domain)
+{
+    named = true;
+    domain = trim_domain(domain);
+    if (domain.empty()) return;
+
+    uint32_t current = 0;
+    while (!domain.empty())
+    {
+        const auto label = pop_label(domain);
+        auto &children = nodes[current].children;
+        auto child = std::lower_bound(children.begin(), children.end(), label,
+                                      [](const auto &c, std::string_view l) { return label_less(c.first, l); });
+        if (child != children.end() && !label_less(label, child->first))
+        {
+            current = child->second;
+            continue;
+        }
+        std::string lowered(label);
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(), to_lower_ascii);
+        current = static_cast<uint32_t>(nodes.size());
+        children.emplace(child, std::move(lowered), current);
+        // Growing 'nodes' invalidates 'children', so this has to come last
+        nodes.emplace_back();
+    }
+    nodes[current].terminal = true;
+}
+
+bool identity_matcher_t::matches_domain(std::string_view domain) const
+{
+    if (allows_anyone()) return true;
+
+    domain = trim_domain(domain);
+    uint32_t current = 0;
+    while (!domain.empty())
+    {
+        const auto label = pop_label(domain);
+        const auto &children = nodes[current].children;
+        const auto child = std::lower_bound(children.begin(), children.end(), label,
+                                            [](const auto &c, std::string_view l) { return label_less(c.first, l); });
+        if (child == children.end() || label_less(label, child->first)) return false;
+        current = child->second;
+        if (nodes[current].terminal) return true;
+    }
+    return false;
+}
+
+bool identity_matcher_t::matches(std::string_view identity) const
+{
+    if (allows_anyone()) return true;
+    if (users.find(identity) != users.end()) return true;
+
+    const auto at = identity.rfind('@');
+    return at != std::string_view::npos && matches_domain(identity.substr(at + 1));
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "test-allocations.hpp"
+
+TEST_CASE("identity matcher")
+{
+    SUBCASE("No identities or ANYONE allows everyone")
+    {
+        REQUIRE(identity_matcher_t{}.matches("alice@example.com"));
+        REQUIRE(identity_matcher_t{{anyone_t{}}}.matches("bob"));
+    }
+    SUBCASE("A domain with no labels matches nobody")
+    {
+        for (const auto *domain : {".", ".."})
+        {
+            const identity_matcher_t m{{domain_t{domain}}};
+            REQUIRE_FALSE(m.allows_anyone());
+            REQUIRE_FALSE(m.matches("alice@example.com"));
+            REQUIRE_FALSE(m.matches("alice@"));
+            REQUIRE_FALSE(m.matches_domain("example.com"));
+        }
+        REQUIRE(identity_matcher_t{{domain_t{"."}, user_t{"stu"}}}.matches("stu"));
+    }
+    SUBCASE("Users match exactly")
+    {
+        const identity_matcher_t m{{user_t{"stu"}, user_t{"alice@example.com"}}};
+        REQUIRE(m.matches("stu"));
+        REQUIRE(m.matches("alice@example.com"));
+        REQUIRE_FALSE(m.matches("Stu"));
+        REQUIRE_FALSE(m.matches("bob@example.com"));
+
+        // Long enough that a std::string copy of it could not use the small-string buffer
+        const std::string_view long_user = "someone-with-a-long-name@example.com";
+        const allocation_counter_t counter;
+        const auto matched = m.matches("alice@example.com") && !m.matches(long_user);
+        REQUIRE(counter.counts().allocations == 0);
+        REQUIRE(matched);
+    }
+    SUBCASE("Domains match themselves and their sub-domains")
+    {
+        const identity_matcher_t m{{domain_t{"example.com"}, domain_t{"Methods.ORG."}, user_t{"stu"}}};
+        REQUIRE(m.matches("alice@example.com"));
+        REQUIRE(m.matches("alice@eng.example.com"));
+        REQUIRE(m.matches("alice@EXAMPLE.com"));
+        REQUIRE(m.matches("bob@methods.org"));
+        REQUIRE(m.matches("stu"));
+        REQUIRE_FALSE(m.matches("alice@example.org"));
+        REQUIRE_FALSE(m.matches("alice@badexample.com"));
+        REQUIRE_FALSE(m.matches("alice@com"));
+        REQUIRE_FALSE(m.matches("example.com"));
+        REQUIRE(m.matches_domain("eng.example.com"));
+        REQUIRE_FALSE(m.matches_domain("org"));
+    }
+    SUBCASE("Many domains")
+    {
+        identity_matcher_t m;
+        for (int i = 0; i < 1000; ++i)
+            m.add(domain_t{"dept" + std::to_string(i) + ".example.com"});
+        REQUIRE(m.matches("alice@dept999.example.com"));
+        REQUIRE(m.matches("alice@x.dept0.example.com"));
+        REQUIRE_FALSE(m.matches("alice@dept1000.example.com"));
+        REQUIRE_FALSE(m.matches("alice@example.com"));
+    }
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
@@ -0,0 +1,47 @@
+#ifndef LICENSE_IDENTITY_HPP
+#define LICENSE_IDENTITY_HPP
+
+#include "license.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Answers "is this user allowed by these identity terms?" without scanning the term list. Users are held in a sorted
+// set that is searched by string_view, domains in a trie keyed on reversed labels, so 'alice@eng.example.com' walks
+// 'com' -> 'example' -> 'eng' and matches as soon as it reaches a node that was inserted as a domain.
+class identity_matcher_t
+{
+ public:
+    identity_matcher_t() = default;
+    explicit identity_matcher_t(const std::vector<identity_t> &identities);
+
+    void add(const identity_t &id);
+
+    // An empty matcher (no identity terms) or one holding ANYONE allows every identity. A domain with no labels, such
+    // as '.', is still a term, but matches nobody.
+    bool allows_anyone() const { return anyone || !named; }
+    bool matches(std::string_view identity) const;
+    bool matches_domain(std::string_view domain) const;
+
+ private:
+    struct trie_node_t
+    {
+        // Sorted by (lower-cased) label so lookups can binary search
+        std::vector<std::pair<std::string, uint32_t>> children;
+        bool terminal = false;
+    };
+
+    void add_domain(std::string_view domain);
+
+    bool anyone = false;
+    bool named = false;
+    std::set<std::string, std::less<>> users;
+    std::vector<trie_node_t> nodes{1};
+};
+
+#endif /* LICENSE_IDENTITY_HPP */
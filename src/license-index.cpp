@@ -0,0 +1,463 @@
+#include "license-index.hpp"
+
+#include "ascii.hpp"
+#include "license-decode.hpp"
+#include "license-keywords.hpp"
+#include "license-metrics.hpp"
+#include "license-network.hpp"
+#include "license-trace.hpp"
+
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LICENSE_INDEX_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LICENSE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LICENSE_TARGET_AVX2
+#endif
+
+#include <doctest/doctest.h>
+
+namespace
+{
+unsigned count_trailing_zeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+void append_positions(uint32_t mask, uint32_t base, std::vector<uint32_t> &positions)
+{
+    while (mask != 0)
+    {
+        positions.push_back(base + count_trailing_zeros(mask));
+        mask &= mask - 1;
+    }
+}
+
+void index_scalar(std::string_view text, size_t from, structural_index_t &index)
+{
+    for (auto i = from; i < text.size(); ++i)
+    {
+        const auto c = text[i];
+        if (c == '\n' || c == '\r')
+            index.line_ends.push_back(static_cast<uint32_t>(i));
+        else if (c == '=')
+            index.equals.push_back(static_cast<uint32_t>(i));
+        else if (static_cast<unsigned char>(c) >= 0x80)
+            index.non_ascii.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+#if defined(LICENSE_INDEX_X86)
+void index_sse2(std::string_view text, structural_index_t &index)
+{
+    const auto newline = _mm_set1_epi8('\n');
+    const auto carriage_return = _mm_set1_epi8('\r');
+    const auto equal = _mm_set1_epi8('=');
+    size_t i = 0;
+    for (; i + 16 <= text.size(); i += 16)
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+        const auto ends = _mm_or_si128(_mm_cmpeq_epi8(block, newline), _mm_cmpeq_epi8(block, carriage_return));
+        const auto base = static_cast<uint32_t>(i);
+        append_positions(static_cast<uint32_t>(_mm_movemask_epi8(ends)), base, index.line_ends);
+        append_positions(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, equal))), base, index.equals);
+        // movemask takes the top bit of each byte, which is exactly the non-ASCII bytes
+        append_positions(static_cast<uint32_t>(_mm_movemask_epi8(block)), base, index.non_ascii);
+    }
+    index_scalar(text, i, index);
+}
+
+LICENSE_TARGET_AVX2 void index_avx2(std::string_view text, structural_index_t &index)
+{
+    const auto newline = _mm256_set1_epi8('\n');
+    const auto carriage_return = _mm256_set1_epi8('\r');
+    const auto equal = _mm256_set1_epi8('=');
+    size_t i = 0;
+    for (; i + 32 <= text.size(); i += 32)
+    {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text.data() + i));
+        const auto ends =
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, newline), _mm256_cmpeq_epi8(block, carriage_return));
+        const auto base = static_cast<uint32_t>(i);
+        append_positions(static_cast<uint32_t>(_mm256_movemask_epi8(ends)), base, index.line_ends);
+        append_positions(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, equal))), base,
+                         index.equals);
+        append_positions(static_cast<uint32_t>(_mm256_movemask_epi8(block)), base, index.non_ascii);
+    }
+    index_scalar(text, i, index);
+}
+#endif
+
+std::string_view trim_leading(std::string_view text)
+{
+    while (!text.empty() && is_whitespace(text.front()))
+        text.remove_prefix(1);
+    return text;
+}
+std::string_view trim_trailing(std::string_view text)
+{
+    while (!text.empty() && is_whitespace(text.back()))
+        text.remove_suffix(1);
+    return text;
+}
+template <class Pred>
+size_t span(std::string_view text, size_t from, Pred pred)
+{
+    while (from < text.size() && pred(text[from]))
+        ++from;
+    return from;
+}
+
+// The value of a term that takes one NO_SPACE_STRING. peglib's semantic value for that rule keeps the trailing
+// whitespace, so this does too.
+std::optional<std::string_view> single_word(std::string_view value)
+{
+    const auto word = span(value, 0, [](char c) { return !is_whitespace(c); });
+    if (word == 0 || span(value, word, is_whitespace) != value.size()) return std::nullopt;
+    return value;
+}
+
+// Returns the whole term, built in place: copying an optional expiry holding a date out of here read the bytes only a
+// term length sets, and GCC warned of it
+std::optional<license_term_t> decode_expiry(std::string_view value)
+{
+    value = trim_trailing(value);
+    const auto digits = span(value, 0, is_digit);
+    if (digits == 0) return std::nullopt;
+
+    date::year_month_day ymd{};
+    if (digits == 4 && value.size() > 4 && value[4] == '-')
+    {
+        if (decode_iso8601(value, ymd) != decode_error_t::none) return std::nullopt;
+        return license_term_t{expiry_t{ymd}};
+    }
+
+    const auto word_start = span(value, digits, is_whitespace);
+    const auto word_end = span(value, word_start, is_alpha);
+    const auto word = find_keyword(value.substr(word_start, word_end - word_start));
+    uint16_t count = 0;
+    if (word.keyword == keyword_t::term_unit && word_end == value.size())
+    {
+        if (decode_natural(value.substr(0, digits), count) != decode_error_t::none) return std::nullopt;
+        return license_term_t{expiry_t{term_length_t{count, static_cast<term_length_t::units_t>(word.value)}}};
+    }
+    if (word.keyword == keyword_t::month && digits <= 2)
+    {
+        const auto year_start = span(value, word_end, is_whitespace);
+        uint16_t day = 0, year = 0;
+        if (value.size() - year_start != 4 || decode_natural(value.substr(year_start), year) != decode_error_t::none)
+            return std::nullopt;
+        decode_natural(value.substr(0, digits), day);
+        if (decode_ymd(year, word.value, day, ymd) != decode_error_t::none) return std::nullopt;
+        return license_term_t{expiry_t{ymd}};
+    }
+    return std::nullopt;
+}
+
+std::optional<network_t> decode_network(std::string_view value)
+{
+    value = trim_trailing(value);
+    auto end = span(value, 0, is_network_char);
+    if (end == 0) return std::nullopt;
+    if (end < value.size() && value[end] == '/') end = span(value, end + 1, is_digit);
+    if (end != value.size() || value.back() == '/') return std::nullopt;
+    return parse_network(value);
+}
+
+// Decodes one line, given where its first '=' is (or line.size() if it has none)
+std::optional<license_term_t> decode_line(std::string_view line, size_t equal)
+{
+    const auto name = find_keyword(trim_trailing(trim_leading(line.substr(0, equal))));
+    if (equal == line.size())
+    {
+        switch (name.keyword)
+        {
+        case keyword_t::anyone:
+            return license_term_t{identity_t{anyone_t{}}};
+        case keyword_t::anywhere:
+            return license_term_t{location_t{anywhere_t{}}};
+        case keyword_t::perpetual:
+            return license_term_t{expiry_t{perpetual_t{}}};
+        default:
+            return std::nullopt;
+        }
+    }
+
+    const auto value = trim_leading(line.substr(equal + 1));
+    switch (name.keyword)
+    {
+    case keyword_t::secret:
+        if (value.empty()) return std::nullopt;
+        return license_term_t{secret_t{std::string(value)}};
+    case keyword_t::user:
+        if (const auto word = single_word(value)) return license_term_t{identity_t{user_t{std::string(*word)}}};
+        return std::nullopt;
+    case keyword_t::domain:
+        if (const auto word = single_word(value)) return license_term_t{identity_t{domain_t{std::string(*word)}}};
+        return std::nullopt;
+    case keyword_t::node:
+        if (const auto word = single_word(value))
+        {
+            // NODE_PATTERN's value is its token, without the trailing whitespace
+            if (word->find('*') != std::string_view::npos)
+                return license_term_t{location_t{node_pattern_t{std::string(trim_trailing(*word))}}};
+            return license_term_t{location_t{node_t{std::string(*word)}}};
+        }
+        return std::nullopt;
+    case keyword_t::network:
+        if (const auto network = decode_network(value)) return license_term_t{location_t{*network}};
+        return std::nullopt;
+    case keyword_t::expiry:
+        return decode_expiry(value);
+    default:
+        return std::nullopt;
+    }
+}
+
+// Keywords are ASCII, so a non-ASCII byte ahead of the '=' can only be an error. Past it, peglib steps over UTF-8
+// sequences going by the lead byte alone, which agrees with reading the line byte by byte only when each sequence is
+// well formed. Advances 'next' past the non-ASCII bytes before 'stop'.
+bool well_formed_utf8(std::string_view text,
+                      const std::vector<uint32_t> &non_ascii,
+                      size_t &next,
+                      size_t equal,
+                      size_t stop)
+{
+    while (next < non_ascii.size() && non_ascii[next] < stop)
+    {
+        const size_t lead = non_ascii[next];
+        const auto length = utf8_sequence_length(text[lead]);
+        if (lead < equal || length < 2 || lead + length > stop) return false;
+        for (size_t i = 1; i < length; ++i)
+        {
+            if (next + i == non_ascii.size() || non_ascii[next + i] != lead + i ||
+                (static_cast<unsigned char>(text[lead + i]) & 0xC0) != 0x80)
+            { return false; }
+        }
+        next += length;
+    }
+    return true;
+}
+
+// The second stage. Returns false, leaving 'terms' partly filled, for anything it cannot decode with certainty - which
+// includes every kind of error.
+bool decode_lines(std::string_view text, const structural_index_t &index, std::vector<license_term_t> &terms)
+{
+    size_t next_equal = 0;
+    size_t next_non_ascii = 0;
+    size_t start = 0;
+    for (size_t line = 0; line <= index.line_ends.size(); ++line)
+    {
+        const size_t stop = line < index.line_ends.size() ? index.line_ends[line] : text.size();
+        if (stop == start)
+        {
+            // Runs of line ends may separate or follow terms, but the grammar wants a term first
+            if (terms.empty()) return false;
+        }
+        else
+        {
+            while (next_equal < index.equals.size() && index.equals[next_equal] < start)
+                ++next_equal;
+            const size_t equal = next_equal < index.equals.size() && index.equals[next_equal] < stop
+                                     ? index.equals[next_equal]
+                                     : stop;
+            if (!well_formed_utf8(text, index.non_ascii, next_non_ascii, equal, stop)) return false;
+
+            auto term = decode_line(text.substr(start, stop - start), equal - start);
+            if (!term) return false;
+            terms.push_back(std::move(*term));
+        }
+        start = stop + 1;
+    }
+    return !terms.empty();
+}
+} // namespace
+
+const char *to_string(index_kernel_t kernel)
+{
+    switch (kernel)
+    {
+    case index_kernel_t::scalar:
+        return "scalar";
+    case index_kernel_t::sse2:
+        return "sse2";
+    case index_kernel_t::avx2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+index_kernel_t best_index_kernel()
+{
+#if defined(LICENSE_INDEX_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    // AVX2 also needs the OS to save the YMM registers
+    int info[4];
+    __cpuid(info, 1);
+    const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    if (os_saves_ymm && (info[1] & (1 << 5)) != 0) return index_kernel_t::avx2;
+#else
+    if (__builtin_cpu_supports("avx2")) return index_kernel_t::avx2;
+#endif
+    return index_kernel_t::sse2;
+#else
+    return index_kernel_t::scalar;
+#endif
+}
+
+void build_structural_index(std::string_view text, structural_index_t &index, index_kernel_t kernel)
+{
+    index.line_ends.clear();
+    index.equals.clear();
+    index.non_ascii.clear();
+    switch (kernel)
+    {
+#if defined(LICENSE_INDEX_X86)
+    case index_kernel_t::avx2:
+        return index_avx2(text, index);
+    case index_kernel_t::sse2:
+        return index_sse2(text, index);
+#endif
+    default:
+        return index_scalar(text, 0, index);
+    }
+}
+
+void build_structural_index(std::string_view text, structural_index_t &index)
+{
+    static const auto kernel = best_index_kernel();
+    build_structural_index(text, index, kernel);
+}
+
+parse_result_t parse_license_indexed(const peg::parser &parser,
+                                     const date::year_month_day &eval_date,
+                                     std::string_view text,
+                                     std::optional<std::string> const &from_file)
+{
+    if (text.size() < std::numeric_limits<uint32_t>::max())
+    {
+        const auto started = metrics_now();
+        structural_index_t index;
+        {
+            const trace_scope_t trace("index");
+            build_structural_index(text, index);
+        }
+        license_t license;
+        const auto decoded = [&] {
+            const trace_scope_t trace("parse");
+            return decode_lines(text, index, license.terms);
+        }();
+        if (decoded)
+        {
+            record_parse(started, license.terms.size());
+            fold_license_terms(eval_date, license);
+            return parse_result_t{std::move(license), {}};
+        }
+    }
+    return try_parse_license(parser, eval_date, text, from_file);
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-formatters.hpp"
+
+#include <peglib.h>
+
+#include <random>
+
+TEST_CASE("build_structural_index")
+{
+    std::mt19937 random{42};
+    const char alphabet[] = {'a', ' ', '=', '\n', '\r', '\x80', '\xff', '7'};
+    for (const auto size : {0, 1, 15, 16, 17, 31, 32, 33, 100, 1000})
+    {
+        std::string text;
+        for (int i = 0; i < size; ++i)
+            text += alphabet[random() % sizeof(alphabet)];
+
+        structural_index_t expected;
+        build_structural_index(text, expected, index_kernel_t::scalar);
+        for (auto kernel = index_kernel_t::scalar; kernel <= best_index_kernel();
+             kernel = static_cast<index_kernel_t>(static_cast<int>(kernel) + 1))
+        {
+            const auto kernel_name = to_string(kernel);
+            CAPTURE(size);
+            CAPTURE(kernel_name);
+            structural_index_t index;
+            build_structural_index(text, index, kernel);
+            REQUIRE(index.line_ends == expected.line_ends);
+            REQUIRE(index.equals == expected.equals);
+            REQUIRE(index.non_ascii == expected.non_ascii);
+        }
+    }
+
+    structural_index_t index;
+    build_structural_index("user=stu\r\nnode=\xc3\xa9t\xc3\xa9=", index);
+    REQUIRE(index.line_ends == std::vector<uint32_t>{8, 9});
+    REQUIRE(index.equals == std::vector<uint32_t>{4, 14, 20});
+    REQUIRE(index.non_ascii == std::vector<uint32_t>{15, 16, 18, 19});
+}
+
+TEST_CASE("parse_license_indexed agrees with try_parse_license")
+{
+    using namespace date;
+    const auto now = 2019_y / 07 / 30;
+    const std::string_view licenses[] = {
+        "secret = plnink plonk abb\nexpiry = 2 month\nexpiry=2019-12-12\nexpiry=23 may 2012\nanyone\nuser=stu\n"
+        "domain=methods\nanywhere\nnode=cabbage",
+        "secret=a=b \n\n\nPERPETUAL\r\n",
+        "  user = stu \r\n\tdomain = example.com\t\n",
+        "network=10.0.0.0/8\nnetwork = ::1 \nnode=web-* \nnode=db1\nnode=\xc3\xa9t\xc3\xa9",
+        "expiry=2 Weeks\nexpiry=1days\nexpiry = 1 January 2020\nexpiry=9 SEPTEMBER2020 ",
+        // Errors, and quirks of the grammar that the second stage leaves to peglib
+        "",
+        "\nuser=stu",
+        "user=stu\n  \nuser=bob",
+        "us\xc3\xa9r=stu",
+        "expiry=2019-02-30",
+        "expiry=2019- 02-28",
+        "expiry=31 feb 2019",
+        "expiry=99999 days",
+        "expiry=9 Sept 2020",
+        "network=10.0.0.0/33",
+        "network=10.0.0.0/",
+        "node=a b",
+        "anyone=stu",
+        "secret=",
+        "secret=\x80" "abc",
+        "user=a\xc3\n",
+        "user=\xe2\x82\xac \nnode=\xff",
+        "user=\xe2\x82" "a",
+    };
+
+    const auto parser = prepare_parser();
+    REQUIRE(parser.has_value());
+    for (const auto text : licenses)
+    {
+        CAPTURE(text);
+        const auto expected = try_parse_license(*parser, now, text, std::nullopt);
+        const auto result = parse_license_indexed(*parser, now, text, std::nullopt);
+        REQUIRE(result.diagnostics == expected.diagnostics);
+        REQUIRE(result.license.has_value() == expected.license.has_value());
+        if (result.license)
+        {
+            REQUIRE((result.license->terms == expected.license->terms));
+            REQUIRE(result.license->secret == expected.license->secret);
+        }
+    }
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
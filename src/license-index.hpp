@@ -0,0 +1,46 @@
+#ifndef LICENSE_INDEX_HPP
+#define LICENSE_INDEX_HPP
+
+#include "license-parser.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Offsets of the bytes that give a license its structure, found in one vectorized pass over the text
+struct structural_index_t
+{
+    std::vector<uint32_t> line_ends; // '\n' and '\r'
+    std::vector<uint32_t> equals;
+    std::vector<uint32_t> non_ascii;
+};
+
+// Ordered so that every kernel up to the best one is available
+enum class index_kernel_t : uint8_t
+{
+    scalar,
+    sse2,
+    avx2
+};
+
+const char *to_string(index_kernel_t kernel);
+
+// The widest kernel this CPU supports
+index_kernel_t best_index_kernel();
+
+// Texts of 4GB or more cannot be indexed
+void build_structural_index(std::string_view text, structural_index_t &index);
+void build_structural_index(std::string_view text, structural_index_t &index, index_kernel_t kernel);
+
+// Parses large licenses in two stages: build_structural_index finds every line and '=' separator, then each line is
+// decoded directly by the term its keyword names rather than by trying each LicenseTerm alternative in turn. Any line
+// the second stage is not certain of sends the whole text through try_parse_license, so the results - diagnostics
+// included - are always the same.
+parse_result_t parse_license_indexed(const peg::parser &parser,
+                                     const date::year_month_day &eval_date,
+                                     std::string_view text,
+                                     std::optional<std::string> const &from_file);
+
+#endif /* LICENSE_INDEX_HPP */
@@ -0,0 +1,36 @@
+#include "license-keywords.hpp"
+
+#include <doctest/doctest.h>
+
+static_assert(find_keyword("ANYONE") == keyword_match_t{keyword_t::anyone});
+static_assert(find_keyword("Sept") == keyword_match_t{});
+
+TEST_CASE("find_keyword")
+{
+    REQUIRE(find_keyword("anyone") == keyword_match_t{keyword_t::anyone});
+    REQUIRE(find_keyword("AnyWhere") == keyword_match_t{keyword_t::anywhere});
+    REQUIRE(find_keyword("NETWORK") == keyword_match_t{keyword_t::network});
+    REQUIRE(find_keyword("perpetual") == keyword_match_t{keyword_t::perpetual});
+    REQUIRE(find_keyword("Weeks") == keyword_match_t{keyword_t::term_unit, 1});
+    REQUIRE(find_keyword("year") == keyword_match_t{keyword_t::term_unit, 3});
+    REQUIRE(find_keyword("Jan") == keyword_match_t{keyword_t::month, 1});
+    REQUIRE(find_keyword("jul") == keyword_match_t{keyword_t::month, 7});
+    REQUIRE(find_keyword("OCTOBER") == keyword_match_t{keyword_t::month, 10});
+    REQUIRE(find_keyword("september") == keyword_match_t{keyword_t::month, 9});
+
+    REQUIRE(find_keyword("") == keyword_match_t{});
+    REQUIRE(find_keyword("Octiber") == keyword_match_t{});
+    REQUIRE(find_keyword("Ocsober") == keyword_match_t{});
+    REQUIRE(find_keyword("janu") == keyword_match_t{});
+    REQUIRE(find_keyword("septembers") == keyword_match_t{});
+    REQUIRE(find_keyword("any") == keyword_match_t{});
+}
+
+TEST_CASE("find_keyword agrees with the word list")
+{
+    for (const auto &w : keywords_detail::words)
+    {
+        CAPTURE(w.text);
+        REQUIRE(find_keyword(w.text) == w.match);
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef LICENSE_KEYWORDS_HPP
+#define LICENSE_KEYWORDS_HPP
+
+#include "ascii.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Every word that license.peg matches case-insensitively - keywords, term units and month names
+enum class keyword_t : uint8_t
+{
+    none = 0,
+    anyone,
+    anywhere,
+    domain,
+    expiry,
+    network,
+    node,
+    perpetual,
+    secret,
+    user,
+    term_unit, // value is the term_length_t::units_t
+    month      // value is the month number, 1-12
+};
+
+struct keyword_match_t
+{
+    keyword_t keyword = keyword_t::none;
+    uint8_t value = 0;
+};
+constexpr bool operator==(const keyword_match_t &l, const keyword_match_t &r)
+{
+    return l.keyword == r.keyword && l.value == r.value;
+}
+
+namespace keywords_detail
+{
+struct entry_t
+{
+    std::string_view text;
+    keyword_match_t match;
+};
+
+constexpr entry_t words[] = {
+    {"anyone", {keyword_t::anyone}},        {"anywhere", {keyword_t::anywhere}},
+    {"domain", {keyword_t::domain}},        {"expiry", {keyword_t::expiry}},
+    {"network", {keyword_t::network}},      {"node", {keyword_t::node}},
+    {"perpetual", {keyword_t::perpetual}},  {"secret", {keyword_t::secret}},
+    {"user", {keyword_t::user}},            {"day", {keyword_t::term_unit, 0}},
+    {"days", {keyword_t::term_unit, 0}},    {"week", {keyword_t::term_unit, 1}},
+    {"weeks", {keyword_t::term_unit, 1}},   {"month", {keyword_t::term_unit, 2}},
+    {"months", {keyword_t::term_unit, 2}},  {"year", {keyword_t::term_unit, 3}},
+    {"years", {keyword_t::term_unit, 3}},   {"jan", {keyword_t::month, 1}},
+    {"january", {keyword_t::month, 1}},     {"feb", {keyword_t::month, 2}},
+    {"february", {keyword_t::month, 2}},    {"mar", {keyword_t::month, 3}},
+    {"march", {keyword_t::month, 3}},       {"apr", {keyword_t::month, 4}},
+    {"april", {keyword_t::month, 4}},       {"may", {keyword_t::month, 5}},
+    {"jun", {keyword_t::month, 6}},         {"june", {keyword_t::month, 6}},
+    {"jul", {keyword_t::month, 7}},         {"july", {keyword_t::month, 7}},
+    {"aug", {keyword_t::month, 8}},         {"august", {keyword_t::month, 8}},
+    {"sep", {keyword_t::month, 9}},         {"september", {keyword_t::month, 9}},
+    {"oct", {keyword_t::month, 10}},        {"october", {keyword_t::month, 10}},
+    {"nov", {keyword_t::month, 11}},        {"november", {keyword_t::month, 11}},
+    {"dec", {keyword_t::month, 12}},        {"december", {keyword_t::month, 12}},
+};
+
+constexpr size_t table_size = 128;
+constexpr size_t max_length = 9;
+
+// FNV-1a over already case-folded text, with a seed so that a collision-free one can be searched for below
+constexpr size_t hash(std::string_view folded, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (const auto c : folded)
+    {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 15)) & (table_size - 1);
+}
+
+constexpr bool is_perfect(uint32_t seed)
+{
+    bool used[table_size] = {};
+    for (const auto &w : words)
+    {
+        const auto slot = hash(w.text, seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_seed()
+{
+    uint32_t seed = 0;
+    while (!is_perfect(seed))
+        ++seed;
+    return seed;
+}
+
+constexpr uint32_t seed = find_seed();
+
+constexpr std::array<entry_t, table_size> make_table()
+{
+    std::array<entry_t, table_size> table{};
+    for (const auto &w : words)
+        table[hash(w.text, seed)] = w;
+    return table;
+}
+
+constexpr auto table = make_table();
+} // namespace keywords_detail
+
+// Case-folds 'token' once and resolves it with a single probe of a perfect hash table built at compile time
+constexpr keyword_match_t find_keyword(std::string_view token)
+{
+    using namespace keywords_detail;
+    if (token.empty() || token.size() > max_length) return {};
+    char folded[max_length] = {};
+    for (size_t i = 0; i < token.size(); ++i)
+        folded[i] = to_lower_ascii(token[i]);
+    const auto text = std::string_view(folded, token.size());
+    const auto &entry = table[hash(text, seed)];
+    return entry.text == text ? entry.match : keyword_match_t{};
+}
+
+#endif /* LICENSE_KEYWORDS_HPP */
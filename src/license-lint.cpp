@@ -0,0 +1,409 @@
+#include "license-lint.hpp"
+
+#include "ascii.hpp"
+#include "license-decode.hpp"
+#include "license-network.hpp"
+#include "license-trace.hpp"
+
+#include <doctest/doctest.h>
+
+namespace
+{
+constexpr bool is_eol(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+// Each member function recognizes the license.peg rule of the same name, returning the position after the match and
+// any trailing whitespace, or nullptr if the rule does not match. As in peglib, the furthest position a rule failed at
+// locates the problem when no term can be recognized at all.
+class recognizer_t
+{
+ public:
+    explicit recognizer_t(std::string_view text)
+        : begin(text.data()), end(text.data() + text.size()), furthest(text.data())
+    {}
+
+    std::optional<diagnostic_t> license()
+    {
+        auto p = license_term(whitespace(begin));
+        if (p)
+        {
+            while (const auto next = eol(p))
+            {
+                const auto term = license_term(next);
+                if (!term) break;
+                p = term;
+            }
+            while (const auto next = eol(p))
+                p = next;
+        }
+        // A bad value found on the way is reported ahead of the syntax error, as try_parse_license does
+        if (problem) return problem;
+        if (!p) return at(furthest, diagnostic_code_t::syntax_error);
+        if (p != end) return at(p, diagnostic_code_t::syntax_error);
+        return std::nullopt;
+    }
+
+ private:
+    const char *fail(const char *p)
+    {
+        if (p > furthest) furthest = p;
+        return nullptr;
+    }
+
+    diagnostic_t at(const char *p, diagnostic_code_t code) const
+    {
+        size_t line = 1;
+        auto line_start = begin;
+        for (auto i = begin; i != p; ++i)
+        {
+            if (*i == '\n')
+            {
+                ++line;
+                line_start = i + 1;
+            }
+        }
+        return {line, static_cast<size_t>(p - line_start) + 1, code};
+    }
+
+    // Only the first bad value is kept
+    void reject(const char *p, diagnostic_code_t code)
+    {
+        if (!problem) problem = at(p, code);
+    }
+    void reject(const char *p, decode_error_t error)
+    {
+        if (error == decode_error_t::none) return;
+        reject(p, to_diagnostic_code(error));
+    }
+
+    const char *whitespace(const char *p) const
+    {
+        while (p != end && is_whitespace(*p))
+            ++p;
+        return p;
+    }
+
+    // Matches 'word' case-insensitively; 'word' is lower case
+    const char *matches(const char *p, std::string_view word) const
+    {
+        for (const auto c : word)
+        {
+            if (p == end || to_lower_ascii(*p) != c) return nullptr;
+            ++p;
+        }
+        return p;
+    }
+    const char *word(const char *p, std::string_view word)
+    {
+        for (const auto c : word)
+        {
+            if (p == end || to_lower_ascii(*p) != c) return fail(p);
+            ++p;
+        }
+        return p;
+    }
+    const char *keyword(const char *p, std::string_view text)
+    {
+        const auto q = word(p, text);
+        return q ? whitespace(q) : nullptr;
+    }
+    const char *literal(const char *p, char c)
+    {
+        if (p == end || *p != c) return fail(p);
+        return p + 1;
+    }
+    // Repeats (!stop .), where '.' steps over a whole UTF-8 sequence and stops at a byte that cannot start one
+    template <class Stop>
+    const char *characters(const char *p, Stop stop) const
+    {
+        while (p != end && !stop(*p))
+        {
+            const auto length = utf8_sequence_length(*p);
+            if (length == 0 || length > static_cast<size_t>(end - p)) break;
+            p += length;
+        }
+        return p;
+    }
+    const char *digits(const char *p, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i, ++p)
+        {
+            if (p == end || !is_digit(*p)) return fail(p);
+        }
+        return p;
+    }
+
+    const char *license_term(const char *p)
+    {
+        if (const auto q = secret_term(p)) return q;
+        if (const auto q = time_term(p)) return q;
+        if (const auto q = location_term(p)) return q;
+        return identity_term(p);
+    }
+
+    const char *secret_term(const char *p)
+    {
+        if (!(p = keyword(p, "secret")) || !(p = equal(p))) return nullptr;
+        const auto start = p;
+        p = characters(p, is_eol);
+        return p != start ? p : fail(p);
+    }
+
+    const char *location_term(const char *p)
+    {
+        if (const auto q = keyword(p, "anywhere")) return q;
+        if (const auto q = network_term(p)) return q;
+        if (const auto q = node_pattern_term(p)) return q;
+        return node_term(p);
+    }
+    const char *network_term(const char *p)
+    {
+        if (!(p = keyword(p, "network")) || !(p = equal(p))) return nullptr;
+        return network_address(p);
+    }
+    const char *node_pattern_term(const char *p)
+    {
+        if (!(p = keyword(p, "node")) || !(p = equal(p))) return nullptr;
+        return node_pattern(p);
+    }
+    const char *node_term(const char *p)
+    {
+        if (!(p = keyword(p, "node")) || !(p = equal(p))) return nullptr;
+        return no_space_string(p);
+    }
+
+    const char *identity_term(const char *p)
+    {
+        if (const auto q = keyword(p, "anyone")) return q;
+        for (const auto name : {"user", "domain"})
+        {
+            auto q = keyword(p, name);
+            if (q && (q = equal(q)) && (q = no_space_string(q))) return q;
+        }
+        return nullptr;
+    }
+
+    const char *time_term(const char *p)
+    {
+        if (const auto q = keyword(p, "perpetual")) return q;
+        if (!(p = keyword(p, "expiry")) || !(p = equal(p))) return nullptr;
+        if (const auto q = term_length(p)) return q;
+        if (const auto q = iso8601(p)) return q;
+        return named_date(p);
+    }
+
+    const char *term_length(const char *p)
+    {
+        if (!(p = natural(p))) return nullptr;
+        for (const auto unit : {"day", "week", "month", "year"})
+        {
+            if (auto q = word(p, unit))
+            {
+                if (q != end && to_lower_ascii(*q) == 's') ++q;
+                return whitespace(q);
+            }
+        }
+        return nullptr;
+    }
+
+    const char *iso8601(const char *p)
+    {
+        // DASH is a token of its own, so whitespace after each '-' is part of the match - and then a bad format
+        auto q = digits(p, 4);
+        if (!q || !(q = literal(q, '-')) || !(q = digits(whitespace(q), 2)) || !(q = literal(q, '-')) ||
+            !(q = digits(whitespace(q), 2)))
+        { return nullptr; }
+        date::year_month_day ymd;
+        reject(p, decode_iso8601({p, static_cast<size_t>(q - p)}, ymd));
+        return whitespace(q);
+    }
+
+    const char *named_date(const char *p)
+    {
+        static constexpr std::string_view months[][2] = {
+            {"jan", "uary"}, {"feb", "ruary"},  {"mar", "ch"},   {"apr", "il"},
+            {"may", ""},     {"jun", "e"},      {"jul", "y"},    {"aug", "ust"},
+            {"sep", "tember"}, {"oct", "ober"}, {"nov", "ember"}, {"dec", "ember"}};
+
+        auto q = digits(p, 1);
+        if (!q) return nullptr;
+        uint16_t day = static_cast<uint16_t>(*p - '0');
+        if (q != end && is_digit(*q)) day = static_cast<uint16_t>(day * 10 + *q++ - '0');
+        q = whitespace(q);
+
+        uint16_t month = 0;
+        for (size_t i = 0; i < std::size(months) && month == 0; ++i)
+        {
+            if (const auto r = word(q, months[i][0]))
+            {
+                const auto suffix = matches(r, months[i][1]);
+                q = whitespace(suffix ? suffix : r);
+                month = static_cast<uint16_t>(i + 1);
+            }
+        }
+        if (month == 0) return nullptr;
+
+        const auto year_start = q;
+        if (!(q = digits(q, 4))) return nullptr;
+        uint16_t year = 0;
+        decode_natural({year_start, 4}, year);
+        date::year_month_day ymd;
+        reject(p, decode_ymd(year, month, day, ymd));
+        return whitespace(q);
+    }
+
+    const char *equal(const char *p)
+    {
+        const auto q = literal(p, '=');
+        return q ? whitespace(q) : nullptr;
+    }
+
+    const char *eol(const char *p)
+    {
+        if (p == end || !is_eol(*p)) return fail(p);
+        while (p != end && is_eol(*p))
+            ++p;
+        return whitespace(p);
+    }
+
+    const char *natural(const char *p)
+    {
+        auto q = digits(p, 1);
+        if (!q) return nullptr;
+        while (q != end && is_digit(*q))
+            ++q;
+        uint16_t value = 0;
+        reject(p, decode_natural({p, static_cast<size_t>(q - p)}, value));
+        return whitespace(q);
+    }
+
+    const char *no_space_string(const char *p)
+    {
+        const auto q = characters(p, [](char c) { return is_whitespace(c) || is_eol(c); });
+        return q != p ? whitespace(q) : fail(q);
+    }
+
+    const char *node_pattern(const char *p)
+    {
+        p = characters(p, [](char c) { return is_whitespace(c) || is_eol(c) || c == '*'; });
+        if (!(p = literal(p, '*'))) return nullptr;
+        return whitespace(characters(p, [](char c) { return is_whitespace(c) || is_eol(c); }));
+    }
+
+    const char *network_address(const char *p)
+    {
+        auto q = p;
+        while (q != end && is_network_char(*q))
+            ++q;
+        if (q == p) return fail(q);
+        if (q != end && *q == '/' && q + 1 != end && is_digit(q[1]))
+        {
+            q += 2;
+            while (q != end && is_digit(*q))
+                ++q;
+        }
+        if (!parse_network({p, static_cast<size_t>(q - p)})) reject(p, diagnostic_code_t::bad_network);
+        return whitespace(q);
+    }
+
+    const char *begin;
+    const char *end;
+    const char *furthest;
+    std::optional<diagnostic_t> problem;
+};
+} // namespace
+
+std::optional<diagnostic_t> lint_license(std::string_view text)
+{
+    const trace_scope_t trace("lint");
+    return recognizer_t{text}.license();
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "test-allocations.hpp"
+
+#include <peglib.h>
+
+TEST_CASE("lint_license agrees with try_parse_license")
+{
+    using namespace date;
+    using namespace std::literals;
+    const auto now = 2019_y / 07 / 30;
+    const std::string_view licenses[] = {
+        // Good
+        "secret = plnink plonk abb\nexpiry = 2 month\nexpiry=2019-12-12\nexpiry=23 may 2012\nanyone\nuser=stu\n"
+        "domain=methods\nanywhere\nnode=cabbage",
+        "secret=abc",
+        "  perpetual  \n\n",
+        "\n\nuser = stu \r\n\tdomain = example.com\n",
+        "network=10.0.0.0/8\nnetwork = ::1\nnode=web-*\nnode=db1",
+        "expiry=2 Weeks",
+        "expiry=1days",
+        "expiry = 1 January 2020",
+        "expiry=9 SEPTEMBER 2020 ",
+        "expiry=29 feb 2020",
+        "Anyone\nAnyWhere",
+        // Bad values
+        "expiry=2019-02-30",
+        "expiry=2019- 02-28",
+        "expiry=2019-13-01",
+        "secret=abc\nexpiry=31 feb 2019",
+        "expiry=99999 days",
+        "expiry=99999 x",
+        "network=10.0.0.0/33",
+        "network=1.2.3.4.5",
+        // Syntax errors
+        "",
+        "\n",
+        "secret=",
+        "secret=abc\nsecrex=1",
+        "secrex=1",
+        "node cabbage",
+        "secret=abc\nnode cabbage",
+        "network=10.0.0.0/8x",
+        "anywhereX",
+        "expiry=9 Sept 2020",
+        "expiry=12 decades",
+        "user=stu\n  \nuser=bob",
+        // peglib matches whole UTF-8 sequences, going by the lead byte alone
+        "secret=\xc3\xa9t\xc3\xa9\nnode=\xc3\xa9*",
+        "secret=\x80" "abc",
+        "user=a\xc3\n",
+        "user=\xe2\x82\xac \nnode=\xff",
+    };
+
+    const auto parser = prepare_parser();
+    REQUIRE(parser.has_value());
+    for (const auto text : licenses)
+    {
+        CAPTURE(text);
+        const auto result = try_parse_license(*parser, now, text, std::nullopt);
+        const auto expected = result.diagnostics.empty() ? std::nullopt : std::optional(result.diagnostics.front());
+        const auto linted = lint_license(text);
+        REQUIRE(linted.has_value() == expected.has_value());
+        if (linted)
+        {
+            REQUIRE(linted->line == expected->line);
+            REQUIRE(linted->column == expected->column);
+            REQUIRE(linted->code == expected->code);
+        }
+    }
+}
+
+TEST_CASE("linting does not allocate")
+{
+    const std::string_view good = "secret=abc\nexpiry=23 may 2012\nuser=stu\nnetwork=10.0.0.0/8\nnode=web-*\n";
+    const std::string_view bad = "secret=abc\nexpiry=2019-02-30\nnode cabbage\n";
+    const allocation_counter_t counter;
+    const auto good_result = lint_license(good);
+    const auto bad_result = lint_license(bad);
+    const auto counts = counter.counts();
+
+    REQUIRE(counts.allocations == 0);
+    REQUIRE_FALSE(good_result.has_value());
+    REQUIRE(bad_result.has_value());
+    REQUIRE(bad_result->code == diagnostic_code_t::bad_day);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
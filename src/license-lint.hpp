@@ -0,0 +1,14 @@
+#ifndef LICENSE_LINT_HPP
+#define LICENSE_LINT_HPP
+
+#include "license-parser.hpp"
+
+#include <optional>
+#include <string_view>
+
+// Checks a license without building it. This is a hand-written recognizer for license.peg that runs no semantic
+// actions and never allocates, but it reports the same problem try_parse_license would report first, so a license
+// that lints cleanly always parses. Returns nullopt for a good license.
+std::optional<diagnostic_t> lint_license(std::string_view text);
+
+#endif /* LICENSE_LINT_HPP */
@@ -0,0 +1,354 @@
+#include "license-load.hpp"
+
+#include "license-decode.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+// Up to 2^36ns (about a minute), plus the overflow bucket, as for the parse metrics
+constexpr size_t latency_buckets = 141;
+// Checks are drawn before the clock starts, and each thread cycles through its draws
+constexpr size_t draw_count = 4096;
+// Beyond these a run's end, or a slow rate's schedule, does not fit the steady clock's duration
+constexpr double max_duration = 1e6;
+constexpr double min_rate = 1e-3;
+
+std::string_view trim(std::string_view text)
+{
+    const auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return {};
+    return text.substr(first, text.find_last_not_of(" \t\r") + 1 - first);
+}
+
+template <class T>
+bool parse_integer(std::string_view text, T &value)
+{
+    const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
+// strtod also takes 'inf' and 'nan', which no rate or duration may be
+bool parse_real(std::string_view text, double &value)
+{
+    const auto copy = std::string(text);
+    char *end = nullptr;
+    value = std::strtod(copy.c_str(), &end);
+    return !copy.empty() && end == copy.c_str() + copy.size() && std::isfinite(value) && value >= 0;
+}
+
+// Splits 'text' into exactly 'fields.size()' fields separated by blanks
+bool split_fields(std::string_view text, std::vector<std::string_view> &fields)
+{
+    for (auto &field : fields)
+    {
+        text = trim(text);
+        const auto end = std::min(text.find_first_of(" \t"), text.size());
+        if (end == 0) return false;
+        field = text.substr(0, end);
+        text.remove_prefix(end);
+    }
+    return trim(text).empty();
+}
+
+std::optional<workload_check_t> parse_check(std::string_view text)
+{
+    std::vector<std::string_view> fields(5);
+    workload_check_t check;
+    if (!split_fields(text, fields) || !parse_integer(fields[0], check.weight) || check.weight == 0 ||
+        decode_iso8601(fields[4], check.day) != decode_error_t::none)
+        return std::nullopt;
+    check.id = fields[1];
+    check.user = fields[2];
+    check.node = fields[3];
+    return check;
+}
+
+uint64_t to_ns(std::chrono::steady_clock::duration duration)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+void record(histogram_snapshot_t &histogram, uint64_t &max, uint64_t ns)
+{
+    ++histogram.buckets[histogram_bucket(ns, histogram.buckets.size())];
+    ++histogram.count;
+    histogram.sum += ns;
+    max = std::max(max, ns);
+}
+
+void add(histogram_snapshot_t &to, const histogram_snapshot_t &from)
+{
+    to.buckets.resize(from.buckets.size());
+    for (size_t i = 0; i < from.buckets.size(); ++i)
+        to.buckets[i] += from.buckets[i];
+    to.count += from.count;
+    to.sum += from.sum;
+}
+
+// Sleeps until shortly before 'due', then spins, since sleeps overshoot by more than the checks take
+void wait_until(std::chrono::steady_clock::time_point due)
+{
+    constexpr auto slack = std::chrono::microseconds(100);
+    if (due - std::chrono::steady_clock::now() > slack) std::this_thread::sleep_until(due - slack);
+    while (std::chrono::steady_clock::now() < due)
+        ;
+}
+} // namespace
+
+std::optional<workload_t> parse_workload(std::string_view text, const date::year_month_day &today, std::string &error)
+{
+    workload_t workload;
+    workload.issued = today;
+    size_t line_number = 0;
+    while (!text.empty())
+    {
+        ++line_number;
+        const auto end = std::min(text.find('\n'), text.size());
+        const auto line = trim(text.substr(0, end));
+        text.remove_prefix(std::min(end + 1, text.size()));
+        if (line.empty() || line.front() == '#') continue;
+
+        const auto equals = line.find('=');
+        const auto key = trim(line.substr(0, equals));
+        const auto value = equals == std::string_view::npos ? std::string_view{} : trim(line.substr(equals + 1));
+        auto fail = [&](std::string_view message) {
+            error = fmt::format("{}: {}", line_number, message);
+            return std::nullopt;
+        };
+        if (equals == std::string_view::npos) return fail("expected key=value");
+        if (key == "licenses")
+            workload.licenses = std::string(value);
+        else if (key == "issued")
+        {
+            if (decode_iso8601(value, workload.issued) != decode_error_t::none) return fail("bad date");
+        }
+        else if (key == "threads")
+        {
+            if (!parse_integer(value, workload.threads) || workload.threads == 0) return fail("bad thread count");
+        }
+        else if (key == "rate")
+        {
+            if (!parse_real(value, workload.rate) || (workload.rate != 0 && workload.rate < min_rate))
+                return fail("bad rate");
+        }
+        else if (key == "duration")
+        {
+            if (!parse_real(value, workload.duration) || workload.duration == 0 || workload.duration > max_duration)
+                return fail("bad duration");
+        }
+        else if (key == "check")
+        {
+            auto check = parse_check(value);
+            if (!check) return fail("expected 'check=weight license user node YYYY-MM-DD'");
+            workload.checks.push_back(std::move(*check));
+        }
+        else
+            return fail(fmt::format("unknown key '{}'", key));
+    }
+    if (workload.checks.empty())
+    {
+        error = fmt::format("{}: no checks", line_number);
+        return std::nullopt;
+    }
+    return workload;
+}
+
+load_report_t run_load(const workload_t &workload, const load_check_t &check)
+{
+    using clock = std::chrono::steady_clock;
+    std::vector<uint64_t> cumulative;
+    uint64_t total = 0;
+    for (const auto &c : workload.checks)
+        cumulative.push_back(total += c.weight);
+
+    const auto threads = std::max(1u, workload.threads);
+    // At a fixed rate each thread takes every 'threads'th slot of the schedule
+    const auto interval = workload.rate > 0 ? std::chrono::duration<double>(threads / workload.rate)
+                                            : std::chrono::duration<double>::zero();
+    std::vector<std::vector<const workload_check_t *>> draws(threads);
+    for (unsigned index = 0; index < threads; ++index)
+    {
+        std::mt19937_64 random(index);
+        std::uniform_int_distribution<uint64_t> draw(0, total - 1);
+        for (size_t i = 0; i < draw_count; ++i)
+        {
+            const auto drawn = std::upper_bound(cumulative.begin(), cumulative.end(), draw(random));
+            draws[index].push_back(&workload.checks[static_cast<size_t>(drawn - cumulative.begin())]);
+        }
+    }
+
+    std::vector<load_report_t> reports(threads);
+    const auto started = clock::now();
+    const auto end = started + std::chrono::duration_cast<clock::duration>(
+                                   std::chrono::duration<double>(workload.duration));
+    auto worker = [&](unsigned index) {
+        auto &report = reports[index];
+        report.service_ns.buckets.resize(latency_buckets);
+        report.response_ns.buckets.resize(latency_buckets);
+        for (uint64_t i = 0;; ++i)
+        {
+            auto due = clock::now();
+            if (interval > interval.zero())
+            {
+                due = started + std::chrono::duration_cast<clock::duration>(
+                                    interval * (static_cast<double>(i) + static_cast<double>(index) / threads));
+                if (due >= end) break;
+                wait_until(due);
+            }
+            else if (due >= end)
+                break;
+
+            const auto begin = clock::now();
+            const auto result = check(*draws[index][i % draw_count]);
+            const auto done = clock::now();
+            ++report.checks;
+            if (result)
+                ++report.results[static_cast<size_t>(*result)];
+            else
+                ++report.failures;
+            record(report.service_ns, report.max_service_ns, to_ns(done - begin));
+            record(report.response_ns, report.max_response_ns, to_ns(done - due));
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i)
+        pool.emplace_back(worker, i);
+    worker(0);
+    for (auto &t : pool)
+        t.join();
+
+    load_report_t report;
+    report.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - started);
+    for (const auto &r : reports)
+    {
+        report.checks += r.checks;
+        report.failures += r.failures;
+        for (size_t i = 0; i < report.results.size(); ++i)
+            report.results[i] += r.results[i];
+        add(report.service_ns, r.service_ns);
+        add(report.response_ns, r.response_ns);
+        report.max_service_ns = std::max(report.max_service_ns, r.max_service_ns);
+        report.max_response_ns = std::max(report.max_response_ns, r.max_response_ns);
+    }
+    return report;
+}
+
+std::string format_load_report(const load_report_t &report)
+{
+    const auto seconds = std::chrono::duration<double>(report.elapsed).count();
+    auto text = fmt::format("{} checks in {:.2f} s, {:.0f} checks/s\n", report.checks, seconds,
+                            seconds > 0 ? static_cast<double>(report.checks) / seconds : 0);
+    for (size_t i = 0; i < report.results.size(); ++i)
+    {
+        if (report.results[i] > 0)
+            text += fmt::format("  {:<16} {}\n", to_string(static_cast<check_result_t>(i)), report.results[i]);
+    }
+    if (report.failures > 0) text += fmt::format("  {:<16} {}\n", "no answer", report.failures);
+
+    text += fmt::format("{:<12} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}\n", "latency us", "p50", "p90", "p99",
+                        "p99.9", "p99.99", "max");
+    auto row = [&](const char *name, const histogram_snapshot_t &histogram, uint64_t max) {
+        // A bucket's upper bound can be above the largest value actually in it
+        auto us = [&](double q) { return static_cast<double>(std::min(histogram_quantile(histogram, q), max)) / 1000; };
+        text += fmt::format("{:<12} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f}\n", name, us(0.5),
+                            us(0.9), us(0.99), us(0.999), us(0.9999), us(1));
+    };
+    row("service", report.service_ns, report.max_service_ns);
+    row("response", report.response_ns, report.max_response_ns);
+    return text;
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include <atomic>
+
+TEST_CASE("parse_workload")
+{
+    using namespace date;
+    const auto today = 2019_y / 07 / 30;
+    std::string error;
+    const auto workload = parse_workload("# farm\nlicenses=farm\r\nthreads = 4\nrate=2.5e5\nduration=0.5\n\n"
+                                         "check=3 team/build stu@eng.example.com build-1 2019-08-01\n"
+                                         "check=1\tsite  anyone 10.1.2.3 2020-01-31\n",
+                                         today, error);
+    REQUIRE(workload);
+    REQUIRE(workload->licenses == "farm");
+    REQUIRE(workload->issued == today);
+    REQUIRE(workload->threads == 4);
+    REQUIRE(workload->rate == 250000);
+    REQUIRE(workload->duration == 0.5);
+    REQUIRE(workload->checks.size() == 2);
+    REQUIRE(workload->checks[0].weight == 3);
+    REQUIRE(workload->checks[0].user == "stu@eng.example.com");
+    REQUIRE(workload->checks[1].node == "10.1.2.3");
+    REQUIRE(workload->checks[1].day == 2020_y / 1 / 31);
+
+    REQUIRE_FALSE(parse_workload("check=1 a b c 2019-01-01\nthreads=0\n", today, error));
+    REQUIRE(error == "2: bad thread count");
+    REQUIRE_FALSE(parse_workload("check=1 a b 2019-01-01\n", today, error));
+    REQUIRE(error == "1: expected 'check=weight license user node YYYY-MM-DD'");
+    REQUIRE_FALSE(parse_workload("check=0 a b c 2019-01-01\n", today, error));
+    REQUIRE_FALSE(parse_workload("check=1 a b c 2019-02-30\n", today, error));
+    REQUIRE_FALSE(parse_workload("check=1 a b c 2019-01-01\nspeed=fast\n", today, error));
+    REQUIRE(error == "2: unknown key 'speed'");
+    REQUIRE_FALSE(parse_workload("rate=-1\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE_FALSE(parse_workload("rate=inf\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE(error == "1: bad rate");
+    REQUIRE_FALSE(parse_workload("duration=1e400\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE(error == "1: bad duration");
+    REQUIRE_FALSE(parse_workload("duration=nan\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE_FALSE(parse_workload("duration=1e12\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE(error == "1: bad duration");
+    REQUIRE_FALSE(parse_workload("rate=1e-300\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE(error == "1: bad rate");
+    REQUIRE(parse_workload("rate=0.001\nduration=1e6\ncheck=1 a b c 2019-01-01\n", today, error));
+    REQUIRE_FALSE(parse_workload("threads=2\n", today, error));
+    REQUIRE(error == "1: no checks");
+}
+
+TEST_CASE("run_load")
+{
+    using namespace date;
+    workload_t workload;
+    workload.threads = 2;
+    workload.duration = 0.05;
+    workload.checks = {{3, "a", "stu", "build-1", 2019_y / 8 / 1}, {1, "b", "stu", "build-1", 2019_y / 8 / 1}};
+    std::atomic<uint64_t> calls{0};
+    const auto check = [&](const workload_check_t &c) -> std::optional<check_result_t> {
+        ++calls;
+        if (c.id == "a") return check_result_t::allowed;
+        return std::nullopt;
+    };
+
+    SUBCASE("Flat out")
+    {
+        const auto report = run_load(workload, check);
+        REQUIRE(report.checks == calls);
+        REQUIRE(report.checks > 100);
+        REQUIRE(report.results[static_cast<size_t>(check_result_t::allowed)] + report.failures == report.checks);
+        // Three in four draws are of 'a'
+        REQUIRE(report.failures > report.checks / 8);
+        REQUIRE(report.failures < report.checks / 2);
+        REQUIRE(report.service_ns.count == report.checks);
+        REQUIRE(report.response_ns.count == report.checks);
+    }
+    SUBCASE("At a fixed rate")
+    {
+        workload.rate = 4000;
+        const auto report = run_load(workload, check);
+        REQUIRE(report.checks >= 195);
+        REQUIRE(report.checks <= 205);
+        REQUIRE(report.max_response_ns >= report.max_service_ns);
+    }
+    REQUIRE_FALSE(format_load_report(run_load(workload, check)).empty());
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
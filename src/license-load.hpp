@@ -0,0 +1,70 @@
+#ifndef LICENSE_LOAD_HPP
+#define LICENSE_LOAD_HPP
+
+#include "license-check.hpp"
+#include "license-metrics.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Load testing for license checks. A workload file is 'key=value' lines, like a license:
+//
+//   licenses=farm/licenses   directory loaded with load_license_store, relative to the workload file
+//   issued=2019-07-30        the issue date for term lengths (default: today)
+//   threads=4
+//   rate=200000              checks per second across all threads, at least 0.001; 0, the default, runs flat out
+//   duration=10              seconds, at most 1000000
+//   check=3 team/build stu@eng.example.com build-1 2019-08-01
+//
+// Each 'check' is a weight, a license ID, a user, a node and a day, and checks are drawn at random in proportion to
+// their weights. Blank lines and lines starting with '#' are ignored.
+struct workload_check_t
+{
+    uint32_t weight = 1;
+    std::string id;
+    std::string user;
+    std::string node;
+    date::year_month_day day;
+};
+
+struct workload_t
+{
+    std::filesystem::path licenses;
+    date::year_month_day issued;
+    unsigned threads = 1;
+    double rate = 0;
+    double duration = 10;
+    std::vector<workload_check_t> checks;
+};
+
+// 'error' is set to 'line: message' on failure
+std::optional<workload_t> parse_workload(std::string_view text, const date::year_month_day &today, std::string &error);
+
+struct load_report_t
+{
+    uint64_t checks = 0;
+    uint64_t failures = 0; // checks that got no answer
+    std::chrono::nanoseconds elapsed{};
+    std::vector<uint64_t> results = std::vector<uint64_t>(check_result_count);
+    // From starting each check to its answer
+    histogram_snapshot_t service_ns;
+    // From when each check was due to its answer. At a fixed rate a slow check delays the ones queued behind it, and
+    // measuring from when they were due rather than when they started counts that delay (coordinated omission).
+    histogram_snapshot_t response_ns;
+    uint64_t max_service_ns = 0;
+    uint64_t max_response_ns = 0;
+};
+
+// Nothing if the check could not be made
+using load_check_t = std::function<std::optional<check_result_t>(const workload_check_t &check)>;
+
+load_report_t run_load(const workload_t &workload, const load_check_t &check);
+std::string format_load_report(const load_report_t &report);
+
+#endif /* LICENSE_LOAD_HPP */
@@ -0,0 +1,253 @@
+#include "license-location.hpp"
+
+#include "ascii.hpp"
+#include "overloaded.hpp"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+// NFA positions are indices into a flat symbol list holding every pattern back to back. A symbol is a lower-cased
+// byte, a '*' or the end of a pattern.
+constexpr int16_t star_symbol = -1;
+constexpr int16_t accept_symbol = -2;
+
+// Adds position 'pos' and everything reachable from it without consuming input ('*' may match nothing)
+void add_closure(const std::vector<int16_t> &symbols, uint32_t pos, std::vector<uint32_t> &set)
+{
+    set.push_back(pos);
+    while (symbols[pos] == star_symbol)
+        set.push_back(++pos);
+}
+} // namespace
+
+location_matcher_t::location_matcher_t(const std::vector<location_t> &locations)
+    : anywhere(locations.empty())
+{
+    std::vector<std::pair<std::string_view, bool>> patterns;
+    for (const auto &location : locations)
+    {
+        std::visit(overloaded{[&](const anywhere_t &) { anywhere = true; },
+                              [&](const node_t &n) { patterns.emplace_back(n.get(), false); },
+                              [&](const node_pattern_t &n) { patterns.emplace_back(n.get(), true); },
+                              [&](const network_t &n) { networks.insert(n); }},
+                   location);
+    }
+    if (!anywhere && !patterns.empty()) compile_nodes(patterns);
+}
+
+void location_matcher_t::compile_nodes(const std::vector<std::pair<std::string_view, bool>> &patterns)
+{
+    for (const auto &[text, is_glob] : patterns)
+    {
+        const auto pattern_start = symbols.size();
+        for (const auto c : text)
+        {
+            if (is_glob && c == '*')
+            {
+                // 'a**b' is the same as 'a*b'
+                if (symbols.size() == pattern_start || symbols.back() != star_symbol) symbols.push_back(star_symbol);
+                continue;
+            }
+            const auto lower = static_cast<uint8_t>(to_lower_ascii(c));
+            if (byte_class[lower] == 0)
+            {
+                byte_class[lower] = static_cast<uint8_t>(class_count++);
+                if (lower >= 'a' && lower <= 'z') byte_class[lower - 'a' + 'A'] = byte_class[lower];
+            }
+            symbols.push_back(lower);
+        }
+        symbols.push_back(accept_symbol);
+        add_closure(symbols, static_cast<uint32_t>(pattern_start), start);
+    }
+
+    // Subset construction: each DFA state is the set of NFA positions that could be live at that point in the name
+    std::map<std::vector<uint32_t>, uint32_t> state_ids;
+    std::vector<std::vector<uint32_t>> states(1);
+    const auto intern = [&](std::vector<uint32_t> &&set) -> uint32_t {
+        if (set.empty()) return 0;
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+        const auto [it, inserted] = state_ids.emplace(set, static_cast<uint32_t>(states.size()));
+        if (inserted) states.push_back(std::move(set));
+        return it->second;
+    };
+
+    intern(std::vector<uint32_t>(start));
+    transitions.assign(class_count, 0);
+    accepting.assign(1, 0);
+    std::vector<std::vector<uint32_t>> next(class_count);
+    for (uint32_t state = 1; state < states.size(); ++state)
+    {
+        for (auto &n : next)
+            n.clear();
+        bool accepts = false;
+        for (const auto pos : states[state])
+        {
+            const auto symbol = symbols[pos];
+            if (symbol == accept_symbol)
+                accepts = true;
+            else if (symbol == star_symbol)
+                for (auto &n : next)
+                    add_closure(symbols, pos, n);
+            else
+                add_closure(symbols, pos + 1, next[byte_class[symbol]]);
+        }
+        accepting.push_back(accepts);
+        for (auto &n : next)
+        {
+            const auto target = intern(std::move(n));
+            transitions.push_back(target);
+        }
+        if (states.size() > max_dfa_states + 1)
+        {
+            transitions = {};
+            accepting = {};
+            return;
+        }
+    }
+    symbols = {};
+    start = {};
+}
+
+bool location_matcher_t::simulate(std::string_view node) const
+{
+    // 'seen' keeps each set free of repeats, so a step costs at most one visit per position
+    std::vector<uint32_t> current, next;
+    std::vector<uint8_t> seen(symbols.size());
+    const auto add = [&](std::vector<uint32_t> &set, uint32_t pos) {
+        for (;; ++pos)
+        {
+            if (!seen[pos]) set.push_back(pos);
+            seen[pos] = 1;
+            if (symbols[pos] != star_symbol) break;
+        }
+    };
+    for (const auto pos : start)
+        add(current, pos);
+    for (const auto c : node)
+    {
+        std::fill(seen.begin(), seen.end(), 0);
+        const auto lower = static_cast<int16_t>(static_cast<uint8_t>(to_lower_ascii(c)));
+        next.clear();
+        for (const auto pos : current)
+        {
+            if (symbols[pos] == star_symbol)
+                add(next, pos);
+            else if (symbols[pos] == lower)
+                add(next, pos + 1);
+        }
+        if (next.empty()) return false;
+        std::swap(current, next);
+    }
+    return std::any_of(current.begin(), current.end(), [&](uint32_t pos) { return symbols[pos] == accept_symbol; });
+}
+
+bool location_matcher_t::matches_node(std::string_view node) const
+{
+    if (anywhere) return true;
+    if (!symbols.empty()) return simulate(node);
+    if (accepting.empty()) return false;
+
+    uint32_t state = 1;
+    for (const auto c : node)
+    {
+        state = transitions[state * class_count + byte_class[static_cast<uint8_t>(c)]];
+        if (state == 0) return false;
+    }
+    return accepting[state] != 0;
+}
+
+bool location_matcher_t::matches_address(const ip_address_t &address) const
+{
+    return anywhere || networks.contains(address);
+}
+
+TEST_CASE("location matcher")
+{
+    SUBCASE("No locations or ANYWHERE allows every node")
+    {
+        REQUIRE(location_matcher_t{}.matches_node("cabbage"));
+        REQUIRE(location_matcher_t{{anywhere_t{}}}.matches_node("cabbage"));
+    }
+    SUBCASE("Node names match exactly, ignoring case")
+    {
+        const location_matcher_t m{{node_t{"cabbage"}, node_t{"carrot"}}};
+        REQUIRE(m.matches_node("cabbage"));
+        REQUIRE(m.matches_node("CARROT"));
+        REQUIRE_FALSE(m.matches_node("cabbages"));
+        REQUIRE_FALSE(m.matches_node("cab"));
+        REQUIRE_FALSE(m.matches_node(""));
+    }
+    SUBCASE("'*' in a node name is only a wildcard in a pattern")
+    {
+        const location_matcher_t m{{node_t{"worker-*"}}};
+        REQUIRE(m.matches_node("worker-*"));
+        REQUIRE_FALSE(m.matches_node("worker-0001"));
+    }
+    SUBCASE("Patterns")
+    {
+        const location_matcher_t m{{node_pattern_t{"worker-*"}, node_pattern_t{"*.example.com"},
+                                    node_pattern_t{"db-*-replica"}, node_t{"cabbage"}}};
+        REQUIRE(m.matches_node("worker-"));
+        REQUIRE(m.matches_node("worker-0001"));
+        REQUIRE(m.matches_node("Worker-0001.example.org"));
+        REQUIRE(m.matches_node("build.example.com"));
+        REQUIRE(m.matches_node(".example.com"));
+        REQUIRE(m.matches_node("db-1-replica"));
+        REQUIRE(m.matches_node("db-1-replica-2-replica"));
+        REQUIRE(m.matches_node("cabbage"));
+        REQUIRE_FALSE(m.matches_node("worker"));
+        REQUIRE_FALSE(m.matches_node("example.com"));
+        REQUIRE_FALSE(m.matches_node("db-1-replica-2"));
+        REQUIRE_FALSE(m.matches_node("cabbage2"));
+    }
+    SUBCASE("Thousands of names compile into one automaton")
+    {
+        std::vector<location_t> locations;
+        for (int i = 0; i < 5000; ++i)
+            locations.push_back(node_t{"worker-" + std::to_string(i)});
+        locations.push_back(node_pattern_t{"batch-*"});
+        const location_matcher_t m{locations};
+        REQUIRE(m.matches_node("worker-0"));
+        REQUIRE(m.matches_node("worker-4999"));
+        REQUIRE(m.matches_node("batch-17"));
+        REQUIRE_FALSE(m.matches_node("worker-5000"));
+        REQUIRE_FALSE(m.matches_node("worker-01"));
+        REQUIRE(m.dfa_states() < 12000);
+    }
+    SUBCASE("Patterns that would need too many DFA states are matched one position set at a time")
+    {
+        // Each pattern has or has not seen its first letter, independently of the others, so the DFA would need over
+        // 2^12 * 7 states
+        std::vector<location_t> locations;
+        const std::string_view letters = "abcdefghijklmnopqrstuvwx";
+        for (size_t i = 0; i < letters.size(); i += 2)
+            locations.push_back(node_pattern_t{std::string("*") + letters[i] + '*' + letters[i + 1]});
+        locations.push_back(node_t{"cabbage"});
+        const location_matcher_t m{locations};
+        REQUIRE(m.dfa_states() == 0);
+        REQUIRE(m.matches_node("ab"));
+        REQUIRE(m.matches_node("xx-W-X"));
+        REQUIRE(m.matches_node("acegikmoqsuwx"));
+        REQUIRE(m.matches_node("Cabbage"));
+        REQUIRE_FALSE(m.matches_node("ba"));
+        REQUIRE_FALSE(m.matches_node("acegikmoqsuw"));
+        REQUIRE_FALSE(m.matches_node("cabbages"));
+        REQUIRE_FALSE(m.matches_node(""));
+    }
+    SUBCASE("Networks")
+    {
+        const location_matcher_t m{{*parse_network("10.0.0.0/8"), *parse_network("2001:db8::/32"), node_t{"cabbage"}}};
+        REQUIRE(m.matches_address(*parse_ip_address("10.1.2.3")));
+        REQUIRE(m.matches_address(*parse_ip_address("2001:db8::1")));
+        REQUIRE_FALSE(m.matches_address(*parse_ip_address("192.168.1.1")));
+        REQUIRE(m.matches_node("cabbage"));
+        REQUIRE(location_matcher_t{{anywhere_t{}}}.matches_address(*parse_ip_address("192.168.1.1")));
+        REQUIRE_FALSE(location_matcher_t{{node_t{"cabbage"}}}.matches_address(*parse_ip_address("192.168.1.1")));
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef LICENSE_LOCATION_HPP
+#define LICENSE_LOCATION_HPP
+
+#include "license-network.hpp"
+#include "license.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Answers "may this license be used on this node?". Every node name and node pattern in the license is compiled into
+// one DFA when the matcher is built, so checking a host name is a single pass over its characters however many
+// 'node=' terms the license has. Patterns such as '*a*b' can need exponentially many DFA states, so past
+// max_dfa_states the DFA is abandoned and names are matched against all the patterns at once, one position set per
+// character. Network terms go into a radix tree and are checked against the node's address.
+class location_matcher_t
+{
+ public:
+    location_matcher_t() = default;
+    explicit location_matcher_t(const std::vector<location_t> &locations);
+
+    // An empty matcher (no location terms) or one holding ANYWHERE allows every node
+    bool allows_anywhere() const { return anywhere; }
+    bool matches_node(std::string_view node) const;
+    bool matches_address(const ip_address_t &address) const;
+
+    static constexpr size_t max_dfa_states = 16384;
+    // 0 if the patterns needed more than max_dfa_states
+    size_t dfa_states() const { return accepting.size(); }
+
+ private:
+    void compile_nodes(const std::vector<std::pair<std::string_view, bool>> &patterns);
+    bool simulate(std::string_view node) const;
+
+    bool anywhere = true;
+    // Node names are matched case-insensitively; bytes that appear in no pattern all share class 0
+    std::array<uint8_t, 256> byte_class{};
+    uint32_t class_count = 1;
+    // State 0 is the dead state, state 1 the start state
+    std::vector<uint32_t> transitions;
+    std::vector<uint8_t> accepting;
+    // Kept only when the DFA is abandoned
+    std::vector<int16_t> symbols;
+    std::vector<uint32_t> start;
+    network_tree_t networks;
+};
+
+#endif /* LICENSE_LOCATION_HPP */
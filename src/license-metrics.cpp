@@ -0,0 +1,318 @@
+#include "license-metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+
+#include <fmt/core.h>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+constexpr size_t shard_count = 16;
+// Up to 2^16 terms and 2^36ns (about a minute), plus the overflow bucket
+constexpr size_t terms_buckets = 61;
+constexpr size_t latency_buckets = 141;
+
+unsigned highest_bit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+    unsigned bit = 0;
+    while (value >>= 1)
+        ++bit;
+    return bit;
+#endif
+}
+
+template <size_t Buckets>
+struct atomic_histogram_t
+{
+    std::array<std::atomic<uint64_t>, Buckets> buckets;
+    std::atomic<uint64_t> sum;
+
+    void record(uint64_t value)
+    {
+        buckets[histogram_bucket(value, Buckets)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void add_to(histogram_snapshot_t &snapshot) const
+    {
+        snapshot.buckets.resize(Buckets);
+        for (size_t i = 0; i < Buckets; ++i)
+        {
+            const auto n = buckets[i].load(std::memory_order_relaxed);
+            snapshot.buckets[i] += n;
+            snapshot.count += n;
+        }
+        snapshot.sum += sum.load(std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (auto &bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+    }
+};
+
+struct alignas(64) shard_t
+{
+    std::atomic<uint64_t> parses;
+    std::array<std::atomic<uint64_t>, diagnostic_code_count + 1> failures;
+    atomic_histogram_t<terms_buckets> terms;
+    atomic_histogram_t<latency_buckets> parse_ns;
+    atomic_histogram_t<latency_buckets> evaluation_ns;
+};
+
+// Static storage, so every counter starts at zero
+shard_t shards[shard_count];
+
+[[maybe_unused]] shard_t &this_thread_shard()
+{
+    static std::atomic<size_t> next_shard{0};
+    thread_local auto &shard = shards[next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count];
+    return shard;
+}
+
+[[maybe_unused]] uint64_t elapsed_ns(std::chrono::steady_clock::time_point started)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+// Prometheus label values, eg "bad_day"
+std::string failure_kind(size_t failure)
+{
+    if (failure == diagnostic_code_count) return "unknown";
+    auto kind = std::string(to_string(static_cast<diagnostic_code_t>(failure)));
+    std::replace(kind.begin(), kind.end(), ' ', '_');
+    return kind;
+}
+
+void format_histogram(std::string &text,
+                      const char *name,
+                      const char *help,
+                      const histogram_snapshot_t &histogram,
+                      double scale)
+{
+    text += fmt::format("# HELP {} {}\n# TYPE {} histogram\n", name, help, name);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i + 1 < histogram.buckets.size(); ++i)
+    {
+        cumulative += histogram.buckets[i];
+        text += fmt::format("{}_bucket{{le=\"{}\"}} {}\n", name, histogram_upper_bound(i) * scale, cumulative);
+    }
+    text += fmt::format("{}_bucket{{le=\"+Inf\"}} {}\n", name, histogram.count);
+    text += fmt::format("{}_sum {}\n{}_count {}\n", name, histogram.sum * scale, name, histogram.count);
+}
+} // namespace
+
+size_t histogram_bucket(uint64_t value, size_t buckets)
+{
+    if (value < 4) return std::min<size_t>(value, buckets - 1);
+    const auto bit = highest_bit(value);
+    const auto bucket = (bit - 1) * 4 + ((value >> (bit - 2)) & 3);
+    return std::min<size_t>(bucket, buckets - 1);
+}
+
+uint64_t histogram_upper_bound(size_t bucket)
+{
+    if (bucket < 4) return bucket;
+    const auto octave = bucket / 4;
+    const auto lower = (4 + bucket % 4) << (octave - 1);
+    return lower + (uint64_t{1} << (octave - 1)) - 1;
+}
+
+uint64_t histogram_quantile(const histogram_snapshot_t &histogram, double q)
+{
+    if (histogram.count == 0) return 0;
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(histogram.count))));
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < histogram.buckets.size(); ++i)
+    {
+        cumulative += histogram.buckets[i];
+        if (cumulative >= rank) return histogram_upper_bound(i);
+    }
+    return histogram_upper_bound(histogram.buckets.size() - 1);
+}
+
+metrics_snapshot_t metrics_snapshot()
+{
+    metrics_snapshot_t snapshot;
+    for (const auto &shard : shards)
+    {
+        snapshot.parses += shard.parses.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < shard.failures.size(); ++i)
+            snapshot.failures[i] += shard.failures[i].load(std::memory_order_relaxed);
+        shard.terms.add_to(snapshot.terms);
+        shard.parse_ns.add_to(snapshot.parse_ns);
+        shard.evaluation_ns.add_to(snapshot.evaluation_ns);
+    }
+    return snapshot;
+}
+
+void reset_metrics()
+{
+    for (auto &shard : shards)
+    {
+        shard.parses.store(0, std::memory_order_relaxed);
+        for (auto &failures : shard.failures)
+            failures.store(0, std::memory_order_relaxed);
+        shard.terms.reset();
+        shard.parse_ns.reset();
+        shard.evaluation_ns.reset();
+    }
+}
+
+std::string format_prometheus(const metrics_snapshot_t &snapshot)
+{
+    auto text = fmt::format("# HELP license_parses_total Licenses parsed, whether or not they were valid\n"
+                            "# TYPE license_parses_total counter\n"
+                            "license_parses_total {}\n"
+                            "# HELP license_parse_failures_total Licenses rejected, by the first problem found\n"
+                            "# TYPE license_parse_failures_total counter\n",
+                            snapshot.parses);
+    for (size_t i = 0; i < snapshot.failures.size(); ++i)
+    {
+        text += fmt::format("license_parse_failures_total{{kind=\"{}\"}} {}\n", failure_kind(i), snapshot.failures[i]);
+    }
+    format_histogram(text, "license_terms", "Terms in each license parsed", snapshot.terms, 1);
+    format_histogram(text, "license_parse_duration_seconds", "Time to parse a license into terms", snapshot.parse_ns,
+                     1e-9);
+    format_histogram(text, "license_evaluation_duration_seconds", "Time to fold a license's terms for a date",
+                     snapshot.evaluation_ns, 1e-9);
+    return text;
+}
+
+bool write_prometheus(const std::filesystem::path &path)
+{
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        auto out = std::ofstream(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+        const auto text = format_prometheus(metrics_snapshot());
+        if (!out || !out.write(text.data(), static_cast<std::streamsize>(text.size()))) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    return !ec;
+}
+
+#if !defined(LICENSE_METRICS_DISABLE)
+void record_parse(metrics_time_t started, size_t terms)
+{
+    auto &shard = this_thread_shard();
+    shard.parses.fetch_add(1, std::memory_order_relaxed);
+    shard.terms.record(terms);
+    shard.parse_ns.record(elapsed_ns(started));
+}
+
+void record_parse_failure(metrics_time_t started, std::optional<diagnostic_code_t> code)
+{
+    auto &shard = this_thread_shard();
+    shard.parses.fetch_add(1, std::memory_order_relaxed);
+    shard.failures[code ? static_cast<size_t>(*code) : diagnostic_code_count].fetch_add(1, std::memory_order_relaxed);
+    shard.parse_ns.record(elapsed_ns(started));
+}
+
+void record_evaluation(metrics_time_t started)
+{
+    this_thread_shard().evaluation_ns.record(elapsed_ns(started));
+}
+#endif
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include <thread>
+
+TEST_CASE("histogram buckets")
+{
+    REQUIRE(histogram_bucket(0, 100) == 0);
+    REQUIRE(histogram_bucket(3, 100) == 3);
+    REQUIRE(histogram_bucket(4, 100) == 4);
+    REQUIRE(histogram_bucket(8, 100) == 8);
+    REQUIRE(histogram_bucket(12, 100) == 10);
+    REQUIRE(histogram_upper_bound(10) == 13);
+    REQUIRE(histogram_bucket(uint64_t{1} << 40, 100) == 99);
+
+    size_t previous = 0;
+    for (uint64_t value = 0; value < 100000; value += 1 + value / 50)
+    {
+        CAPTURE(value);
+        const auto bucket = histogram_bucket(value, 1000);
+        REQUIRE(bucket >= previous);
+        REQUIRE(value <= histogram_upper_bound(bucket));
+        REQUIRE(histogram_upper_bound(bucket) <= value + value / 4);
+        if (bucket > 0) REQUIRE(value > histogram_upper_bound(bucket - 1));
+        previous = bucket;
+    }
+
+    histogram_snapshot_t histogram;
+    REQUIRE(histogram_quantile(histogram, 0.5) == 0);
+    histogram.buckets.resize(100);
+    for (uint64_t value = 1; value <= 100; ++value)
+    {
+        ++histogram.buckets[histogram_bucket(value, 100)];
+        ++histogram.count;
+    }
+    REQUIRE(histogram_quantile(histogram, 0) == 1);
+    REQUIRE(histogram_quantile(histogram, 0.5) == 55);
+    REQUIRE(histogram_quantile(histogram, 0.99) == 111);
+    REQUIRE(histogram_quantile(histogram, 1) == 111);
+}
+
+#if !defined(LICENSE_METRICS_DISABLE)
+TEST_CASE("parse metrics")
+{
+    const auto now = date::year_month_day{date::year{2019} / 7 / 30};
+    reset_metrics();
+    REQUIRE(try_parse_license(now, "secret=abc\nuser=stu\nanywhere\n", std::nullopt).license);
+    REQUIRE_FALSE(try_parse_license(now, "secret=abc\nexpiry=2019-02-30\n", std::nullopt).license);
+    REQUIRE_FALSE(try_parse_license(now, "secret=abc\nexpiry sometime\n", std::nullopt).license);
+    REQUIRE_FALSE(parse_license(now, "secret=abc\nexpiry sometime\n", std::nullopt));
+
+    auto snapshot = metrics_snapshot();
+    REQUIRE(snapshot.parses == 4);
+    REQUIRE(snapshot.failures[static_cast<size_t>(diagnostic_code_t::bad_day)] == 1);
+    REQUIRE(snapshot.failures[static_cast<size_t>(diagnostic_code_t::syntax_error)] == 1);
+    REQUIRE(snapshot.failures[diagnostic_code_count] == 1);
+    REQUIRE(snapshot.terms.count == 1);
+    REQUIRE(snapshot.terms.sum == 3);
+    REQUIRE(snapshot.parse_ns.count == 4);
+    REQUIRE(snapshot.evaluation_ns.count == 1);
+
+    const auto text = format_prometheus(snapshot);
+    REQUIRE(text.find("license_parses_total 4\n") != std::string::npos);
+    REQUIRE(text.find("license_parse_failures_total{kind=\"bad_day\"} 1\n") != std::string::npos);
+    REQUIRE(text.find("license_parse_failures_total{kind=\"unknown\"} 1\n") != std::string::npos);
+    REQUIRE(text.find("license_terms_bucket{le=\"2\"} 0\nlicense_terms_bucket{le=\"3\"} 1\n") != std::string::npos);
+    REQUIRE(text.find("license_terms_bucket{le=\"+Inf\"} 1\nlicense_terms_sum 3\nlicense_terms_count 1\n") !=
+            std::string::npos);
+    REQUIRE(text.find("# TYPE license_parse_duration_seconds histogram\n") != std::string::npos);
+    REQUIRE(text.find("license_parse_duration_seconds_count 4\n") != std::string::npos);
+
+    // Every thread's records are summed, whichever shards they landed in
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.emplace_back([] {
+            for (int j = 0; j < 1000; ++j)
+                record_parse(metrics_now(), 2);
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+    snapshot = metrics_snapshot();
+    REQUIRE(snapshot.parses == 8004);
+    REQUIRE(snapshot.terms.sum == 16003);
+
+    reset_metrics();
+    REQUIRE(metrics_snapshot().parses == 0);
+}
+#endif // !defined(LICENSE_METRICS_DISABLE)
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
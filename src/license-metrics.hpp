@@ -0,0 +1,76 @@
+#ifndef LICENSE_METRICS_HPP
+#define LICENSE_METRICS_HPP
+
+#include "license-parser.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Counters and latency histograms for the parse path, for services that embed the library. Recording is a relaxed
+// atomic add into the calling thread's shard, so threads rarely share a cache line; a snapshot sums the shards.
+// Defining LICENSE_METRICS_DISABLE compiles every record_* call, and the clock reads feeding them, away.
+
+// Log-linear buckets in the style of HDR histograms. Values below 4 get a bucket each, and each power of two above
+// that is split into four, so a bucket's upper bound is within 25% of any value in it. The last bucket holds
+// everything too large for the others.
+size_t histogram_bucket(uint64_t value, size_t buckets);
+uint64_t histogram_upper_bound(size_t bucket);
+
+struct histogram_snapshot_t
+{
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+};
+
+// The upper bound of the bucket holding the value at quantile 'q' (0 to 1), or 0 for an empty histogram
+uint64_t histogram_quantile(const histogram_snapshot_t &histogram, double q);
+
+constexpr size_t diagnostic_code_count = static_cast<size_t>(diagnostic_code_t::bad_network) + 1;
+
+struct metrics_snapshot_t
+{
+    uint64_t parses = 0;
+    // By the first diagnostic, with a last entry for failures parse_license cannot explain
+    std::vector<uint64_t> failures = std::vector<uint64_t>(diagnostic_code_count + 1);
+    histogram_snapshot_t terms;
+    histogram_snapshot_t parse_ns;
+    histogram_snapshot_t evaluation_ns;
+};
+
+metrics_snapshot_t metrics_snapshot();
+void reset_metrics();
+
+// The Prometheus text exposition format. The file is written alongside and renamed into place, so a collector never
+// reads half a snapshot.
+std::string format_prometheus(const metrics_snapshot_t &snapshot);
+bool write_prometheus(const std::filesystem::path &path);
+
+#if defined(LICENSE_METRICS_DISABLE)
+struct metrics_time_t
+{
+};
+inline metrics_time_t metrics_now()
+{
+    return {};
+}
+inline void record_parse(metrics_time_t, size_t) {}
+inline void record_parse_failure(metrics_time_t, std::optional<diagnostic_code_t>) {}
+inline void record_evaluation(metrics_time_t) {}
+#else
+using metrics_time_t = std::chrono::steady_clock::time_point;
+inline metrics_time_t metrics_now()
+{
+    return std::chrono::steady_clock::now();
+}
+// Each takes the time the work started
+void record_parse(metrics_time_t started, size_t terms);
+void record_parse_failure(metrics_time_t started, std::optional<diagnostic_code_t> code);
+void record_evaluation(metrics_time_t started);
+#endif
+
+#endif /* LICENSE_METRICS_HPP */
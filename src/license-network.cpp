@@ -0,0 +1,351 @@
+#include "license-network.hpp"
+
+#include "ascii.hpp"
+
+#include <algorithm>
+
+#include <doctest/doctest.h>
+#include <fmt/core.h>
+
+namespace
+{
+constexpr uint8_t v4_mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c = to_lower_ascii(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool parse_ipv4(std::string_view text, uint8_t *octets)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i > 0)
+        {
+            if (text.empty() || text.front() != '.') return false;
+            text.remove_prefix(1);
+        }
+        unsigned value = 0;
+        size_t digits = 0;
+        while (digits < text.size() && digits < 3 && text[digits] >= '0' && text[digits] <= '9')
+            value = value * 10 + static_cast<unsigned>(text[digits++] - '0');
+        if (digits == 0 || value > 255) return false;
+        octets[i] = static_cast<uint8_t>(value);
+        text.remove_prefix(digits);
+    }
+    return text.empty();
+}
+
+std::optional<ip_address_t> parse_ipv6(std::string_view text)
+{
+    // Groups before a '::' fill 'head', groups after it fill 'tail', and the gap is zero-filled
+    std::array<uint8_t, 16> head{}, tail{};
+    size_t head_size = 0, tail_size = 0;
+    bool seen_gap = false;
+    auto *bytes = &head;
+    auto *size = &head_size;
+
+    if (text.substr(0, 2) == "::")
+    {
+        seen_gap = true;
+        bytes = &tail;
+        size = &tail_size;
+        text.remove_prefix(2);
+    }
+    while (!text.empty())
+    {
+        // An embedded IPv4 address can only finish the address
+        if (text.find(':') == std::string_view::npos && text.find('.') != std::string_view::npos)
+        {
+            if (*size + 4 > 16 || !parse_ipv4(text, bytes->data() + *size)) return std::nullopt;
+            *size += 4;
+            break;
+        }
+        unsigned group = 0;
+        size_t digits = 0;
+        while (digits < text.size() && digits < 4 && hex_value(text[digits]) >= 0)
+            group = group * 16 + static_cast<unsigned>(hex_value(text[digits++]));
+        if (digits == 0 || *size + 2 > 16) return std::nullopt;
+        (*bytes)[(*size)++] = static_cast<uint8_t>(group >> 8);
+        (*bytes)[(*size)++] = static_cast<uint8_t>(group & 0xff);
+        text.remove_prefix(digits);
+
+        if (text.empty()) break;
+        if (text.front() != ':' || text.size() == 1) return std::nullopt;
+        text.remove_prefix(1);
+        if (text.front() == ':')
+        {
+            if (seen_gap) return std::nullopt;
+            seen_gap = true;
+            bytes = &tail;
+            size = &tail_size;
+            text.remove_prefix(1);
+        }
+    }
+
+    const auto total = head_size + tail_size;
+    if (seen_gap ? total > 14 : total != 16) return std::nullopt;
+    ip_address_t address{};
+    std::copy_n(head.begin(), head_size, address.begin());
+    std::copy_n(tail.begin(), tail_size, address.end() - static_cast<std::ptrdiff_t>(tail_size));
+    return address;
+}
+
+bool get_bit(const ip_address_t &address, unsigned bit)
+{
+    return (address[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+unsigned common_prefix_length(const ip_address_t &l, const ip_address_t &r, unsigned limit)
+{
+    unsigned bits = 0;
+    for (size_t i = 0; i < l.size() && bits < limit; ++i, bits += 8)
+    {
+        if (const auto diff = static_cast<uint8_t>(l[i] ^ r[i]); diff != 0)
+        {
+            auto mask = 0x80u;
+            while ((diff & mask) == 0)
+            {
+                ++bits;
+                mask >>= 1;
+            }
+            return std::min(bits, limit);
+        }
+    }
+    return std::min(bits, limit);
+}
+
+ip_address_t mask_address(ip_address_t address, unsigned length)
+{
+    for (unsigned i = 0; i < address.size(); ++i)
+    {
+        if (length >= (i + 1) * 8) continue;
+        address[i] &= (length <= i * 8) ? 0 : static_cast<uint8_t>(0xff << (8 - (length - i * 8)));
+    }
+    return address;
+}
+} // namespace
+
+bool network_t::is_v4() const
+{
+    return prefix_length >= 96 && std::equal(std::begin(v4_mapped_prefix), std::end(v4_mapped_prefix), address.begin());
+}
+
+std::optional<ip_address_t> parse_ip_address(std::string_view text)
+{
+    if (text.find(':') != std::string_view::npos) return parse_ipv6(text);
+
+    ip_address_t address{};
+    std::copy(std::begin(v4_mapped_prefix), std::end(v4_mapped_prefix), address.begin());
+    if (!parse_ipv4(text, address.data() + 12)) return std::nullopt;
+    return address;
+}
+
+std::optional<network_t> parse_network(std::string_view text)
+{
+    const auto slash = text.find('/');
+    const auto address = parse_ip_address(text.substr(0, slash));
+    if (!address) return std::nullopt;
+
+    const auto v4 = text.substr(0, slash).find(':') == std::string_view::npos;
+    const unsigned max_length = v4 ? 32 : 128;
+    unsigned length = max_length;
+    if (slash != std::string_view::npos)
+    {
+        const auto digits = text.substr(slash + 1);
+        if (digits.empty() || digits.size() > 3) return std::nullopt;
+        length = 0;
+        for (const auto c : digits)
+        {
+            if (c < '0' || c > '9') return std::nullopt;
+            length = length * 10 + static_cast<unsigned>(c - '0');
+        }
+        if (length > max_length) return std::nullopt;
+    }
+    if (v4) length += 96;
+    return network_t{mask_address(*address, length), static_cast<uint8_t>(length)};
+}
+
+std::string to_string(const network_t &network)
+{
+    const auto &a = network.address;
+    if (network.is_v4()) return fmt::format("{}.{}.{}.{}/{}", a[12], a[13], a[14], a[15], network.prefix_length - 96);
+
+    // RFC 5952 form - lower case, no leading zeros, and the first longest run of two or more zero groups as '::'
+    uint16_t groups[8];
+    for (size_t i = 0; i < 8; ++i)
+        groups[i] = static_cast<uint16_t>(a[i * 2] << 8 | a[i * 2 + 1]);
+    size_t gap_start = 8, gap_size = 1;
+    for (size_t i = 0; i < 8;)
+    {
+        size_t j = i;
+        while (j < 8 && groups[j] == 0)
+            ++j;
+        if (j - i > gap_size)
+        {
+            gap_start = i;
+            gap_size = j - i;
+        }
+        i = (j == i) ? i + 1 : j;
+    }
+    std::string text;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        if (i == gap_start)
+        {
+            text += "::";
+            i += gap_size - 1;
+            continue;
+        }
+        if (!text.empty() && text.back() != ':') text += ':';
+        text += fmt::format("{:x}", groups[i]);
+    }
+    return fmt::format("{}/{}", text, network.prefix_length);
+}
+
+void network_tree_t::insert(const network_t &network)
+{
+    const unsigned length = network.prefix_length;
+    const auto prefix = mask_address(network.address, length);
+    uint32_t current = 0;
+    while (nodes[current].length < length)
+    {
+        const auto bit = get_bit(prefix, nodes[current].length);
+        const auto child = nodes[current].child[bit];
+        if (child == 0)
+        {
+            nodes[current].child[bit] = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(tree_node_t{prefix, static_cast<uint8_t>(length), true});
+            return;
+        }
+        const auto common =
+            common_prefix_length(prefix, nodes[child].prefix, std::min<unsigned>(length, nodes[child].length));
+        if (common == nodes[child].length)
+        {
+            current = child;
+            continue;
+        }
+
+        // The new network diverges part way along the child's edge - split the edge at the divergence point
+        tree_node_t split{mask_address(prefix, common), static_cast<uint8_t>(common), common == length};
+        split.child[get_bit(nodes[child].prefix, common)] = child;
+        const auto split_index = static_cast<uint32_t>(nodes.size());
+        if (common < length)
+        {
+            split.child[get_bit(prefix, common)] = split_index + 1;
+            nodes.push_back(split);
+            nodes.push_back(tree_node_t{prefix, static_cast<uint8_t>(length), true});
+        }
+        else
+        {
+            nodes.push_back(split);
+        }
+        nodes[current].child[bit] = split_index;
+        return;
+    }
+    nodes[current].terminal = true;
+}
+
+bool network_tree_t::contains(const ip_address_t &address) const
+{
+    uint32_t current = 0;
+    while (true)
+    {
+        const auto &node = nodes[current];
+        if (common_prefix_length(address, node.prefix, node.length) < node.length) return false;
+        if (node.terminal) return true;
+        if (node.length == 128) return false;
+        current = node.child[get_bit(address, node.length)];
+        if (current == 0) return false;
+    }
+}
+
+TEST_CASE("parse IP addresses")
+{
+    const auto v4 = [](uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+        return ip_address_t{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, a, b, c, d};
+    };
+    REQUIRE(parse_ip_address("10.0.0.1") == v4(10, 0, 0, 1));
+    REQUIRE(parse_ip_address("255.255.255.255") == v4(255, 255, 255, 255));
+    REQUIRE(parse_ip_address("::ffff:10.0.0.1") == v4(10, 0, 0, 1));
+    REQUIRE(parse_ip_address("::") == ip_address_t{});
+    REQUIRE(parse_ip_address("::1") == ip_address_t{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1});
+    REQUIRE(parse_ip_address("2001:DB8::8:800:200c:417a") ==
+            ip_address_t{0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0x08, 0x08, 0, 0x20, 0x0c, 0x41, 0x7a});
+    REQUIRE(parse_ip_address("fe80::") == ip_address_t{0xfe, 0x80});
+    REQUIRE(parse_ip_address("1:2:3:4:5:6:7:8") ==
+            ip_address_t{0, 1, 0, 2, 0, 3, 0, 4, 0, 5, 0, 6, 0, 7, 0, 8});
+
+    REQUIRE_FALSE(parse_ip_address(""));
+    REQUIRE_FALSE(parse_ip_address("10.0.0"));
+    REQUIRE_FALSE(parse_ip_address("10.0.0.256"));
+    REQUIRE_FALSE(parse_ip_address("10.0.0.1.2"));
+    REQUIRE_FALSE(parse_ip_address("1:2:3:4:5:6:7"));
+    REQUIRE_FALSE(parse_ip_address("1:2:3:4:5:6:7:8:9"));
+    REQUIRE_FALSE(parse_ip_address("1:2:3:4:5:6:7::8"));
+    REQUIRE_FALSE(parse_ip_address("1::2::3"));
+    REQUIRE_FALSE(parse_ip_address("1:"));
+    REQUIRE_FALSE(parse_ip_address(":1"));
+    REQUIRE_FALSE(parse_ip_address("12345::"));
+}
+
+TEST_CASE("parse and format networks")
+{
+    REQUIRE(to_string(*parse_network("10.0.0.0/8")) == "10.0.0.0/8");
+    REQUIRE(to_string(*parse_network("10.1.2.3/8")) == "10.0.0.0/8");
+    REQUIRE(to_string(*parse_network("192.168.1.17")) == "192.168.1.17/32");
+    REQUIRE(to_string(*parse_network("0.0.0.0/0")) == "0.0.0.0/0");
+    REQUIRE(to_string(*parse_network("2001:0DB8:0000:0000:0000:0000:0000:0001/32")) == "2001:db8::/32");
+    REQUIRE(to_string(*parse_network("2001:db8:0:0:1:0:0:1")) == "2001:db8::1:0:0:1/128");
+    REQUIRE(to_string(*parse_network("::/0")) == "::/0");
+    REQUIRE(parse_network("10.0.0.0/8")->is_v4());
+    REQUIRE_FALSE(parse_network("::/0")->is_v4());
+
+    REQUIRE_FALSE(parse_network("10.0.0.0/33"));
+    REQUIRE_FALSE(parse_network("::/129"));
+    REQUIRE_FALSE(parse_network("10.0.0.0/"));
+    REQUIRE_FALSE(parse_network("10.0.0.0/8a"));
+}
+
+TEST_CASE("network tree")
+{
+    network_tree_t tree;
+    REQUIRE(tree.empty());
+    REQUIRE_FALSE(tree.contains(*parse_ip_address("10.0.0.1")));
+
+    SUBCASE("Nested and disjoint networks")
+    {
+        tree.insert(*parse_network("10.1.0.0/16"));
+        tree.insert(*parse_network("10.0.0.0/8"));
+        tree.insert(*parse_network("192.168.1.0/24"));
+        tree.insert(*parse_network("192.168.2.17"));
+        tree.insert(*parse_network("2001:db8::/32"));
+        REQUIRE(tree.contains(*parse_ip_address("10.200.3.4")));
+        REQUIRE(tree.contains(*parse_ip_address("10.1.3.4")));
+        REQUIRE(tree.contains(*parse_ip_address("192.168.1.255")));
+        REQUIRE(tree.contains(*parse_ip_address("192.168.2.17")));
+        REQUIRE(tree.contains(*parse_ip_address("2001:db8:1::5")));
+        REQUIRE_FALSE(tree.contains(*parse_ip_address("11.0.0.1")));
+        REQUIRE_FALSE(tree.contains(*parse_ip_address("192.168.2.16")));
+        REQUIRE_FALSE(tree.contains(*parse_ip_address("192.168.0.1")));
+        REQUIRE_FALSE(tree.contains(*parse_ip_address("2001:db9::1")));
+    }
+    SUBCASE("Everything")
+    {
+        tree.insert(*parse_network("::/0"));
+        REQUIRE(tree.contains(*parse_ip_address("1.2.3.4")));
+        REQUIRE(tree.contains(*parse_ip_address("fe80::1")));
+    }
+    SUBCASE("Thousands of networks")
+    {
+        for (int i = 0; i < 4096; ++i)
+            tree.insert(*parse_network(fmt::format("10.{}.{}.0/24", i / 16, (i % 16) * 16)));
+        REQUIRE(tree.contains(*parse_ip_address("10.0.0.1")));
+        REQUIRE(tree.contains(*parse_ip_address("10.255.240.9")));
+        REQUIRE_FALSE(tree.contains(*parse_ip_address("10.0.1.1")));
+        REQUIRE_FALSE(tree.contains(*parse_ip_address("10.255.241.1")));
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef LICENSE_NETWORK_HPP
+#define LICENSE_NETWORK_HPP
+
+#include "license.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+std::optional<ip_address_t> parse_ip_address(std::string_view text);
+
+// Accepts 'address/prefix-length' or a plain address (a network holding just that address). Host bits below the
+// prefix are cleared, so '10.1.2.3/8' is the same network as '10.0.0.0/8'.
+std::optional<network_t> parse_network(std::string_view text);
+
+std::string to_string(const network_t &network);
+
+// Path-compressed binary radix tree over 128-bit addresses. A lookup visits at most one node per distinct prefix
+// length on the path to the address, however many networks the tree holds.
+class network_tree_t
+{
+ public:
+    void insert(const network_t &network);
+    bool contains(const ip_address_t &address) const;
+    bool empty() const { return nodes.size() == 1 && !nodes.front().terminal; }
+
+ private:
+    struct tree_node_t
+    {
+        ip_address_t prefix{};
+        uint8_t length = 0;
+        bool terminal = false;
+        uint32_t child[2] = {0, 0};
+    };
+
+    // nodes[0] is the root, which holds the zero length prefix, so 0 also means 'no child'
+    std::vector<tree_node_t> nodes{1};
+};
+
+#endif /* LICENSE_NETWORK_HPP */
@@ -1,15 +1,58 @@
 #include "license-parser.hpp"
 
+#include "license-decode.hpp"
+#include "license-metrics.hpp"
+#include "license-network.hpp"
+#include "license-trace.hpp"
 #include "license.peg.hpp"
 #include "overloaded.hpp"
 
-#include <fmt/core.h>
 #include <peglib.h>
 using namespace peg;
 
-uint16_t to_natural(const SemanticValues &sv)
+// The text a rule matched, without allocating - for a token rule, that excludes any trailing whitespace
+std::string_view matched_text(const SemanticValues &sv)
+{
+    if (!sv.tokens.empty()) return {sv.tokens.front().first, sv.tokens.front().second};
+    return {sv.c_str(), sv.length()};
+}
+
+diagnostic_code_t to_diagnostic_code(decode_error_t error)
+{
+    switch (error)
+    {
+    case decode_error_t::bad_number:
+        return diagnostic_code_t::bad_number;
+    case decode_error_t::out_of_range:
+        return diagnostic_code_t::number_out_of_range;
+    case decode_error_t::bad_year:
+        return diagnostic_code_t::bad_year;
+    case decode_error_t::bad_month:
+        return diagnostic_code_t::bad_month;
+    case decode_error_t::bad_day:
+        return diagnostic_code_t::bad_day;
+    case decode_error_t::none:
+    case decode_error_t::bad_format:
+    default:
+        return diagnostic_code_t::bad_date_format;
+    }
+}
+
+// Rejects a semantically invalid value. try_parse_license passes its diagnostics list as the parse's user data, and
+// then the problem is recorded there and parsing carries on; otherwise the rule fails by peglib's parse_error.
+void reject(const SemanticValues &sv, any &dt, diagnostic_code_t code)
+{
+    if (dt.is_undefined()) throw peg::parse_error(to_string(code));
+    const auto [line, column] = sv.line_info();
+    dt.get<std::vector<diagnostic_t> *>()->push_back({line, column, code});
+}
+
+uint16_t to_natural(const SemanticValues &sv, any &dt)
 {
-    return std::stoul(sv.str());
+    uint16_t value = 0;
+    if (const auto error = decode_natural(matched_text(sv), value); error != decode_error_t::none)
+        reject(sv, dt, to_diagnostic_code(error));
+    return value;
 }
 
 term_length_t::units_t to_term_unit(const SemanticValues &sv)
@@ -17,29 +60,33 @@ term_length_t::units_t to_term_unit(const SemanticValues &sv)
     return static_cast<term_length_t::units_t>(sv.choice());
 }
 
-expiry_t validate_ymd(uint16_t year, uint16_t month, uint16_t day)
+expiry_t to_dmy_expiry(const SemanticValues &sv, any &dt)
 {
-    const auto y = date::year{year};
-    if (!y.ok()) throw peg::parse_error(fmt::format("bad year {}", year).c_str());
-    const auto ym = y / month;
-    if (!ym.ok()) throw peg::parse_error(fmt::format("bad month {}", month).c_str());
-    const auto ymd = ym / day;
-    if (!ymd.ok()) throw peg::parse_error(fmt::format("bad day {}", day).c_str());
+    date::year_month_day ymd{};
+    if (const auto error = decode_ymd(sv[2].get<uint16_t>(), sv[1].get<uint16_t>(), sv[0].get<uint16_t>(), ymd);
+        error != decode_error_t::none)
+    { reject(sv, dt, to_diagnostic_code(error)); }
     return ymd;
 }
 
-expiry_t to_dmy_expiry(const SemanticValues &sv)
+expiry_t to_iso8601_expiry(const SemanticValues &sv, any &dt)
 {
-    return validate_ymd(sv[2].get<uint16_t>(), sv[1].get<uint16_t>(), sv[0].get<uint16_t>());
+    date::year_month_day ymd{};
+    if (const auto error = decode_iso8601(matched_text(sv), ymd); error != decode_error_t::none)
+        reject(sv, dt, to_diagnostic_code(error));
+    return ymd;
 }
 
-expiry_t to_ymd_expiry(const SemanticValues &sv)
+network_t to_network(const SemanticValues &sv, any &dt)
 {
-    return validate_ymd(sv[0].get<uint16_t>(), sv[1].get<uint16_t>(), sv[2].get<uint16_t>());
+    const auto network = parse_network(matched_text(sv));
+    if (!network) reject(sv, dt, diagnostic_code_t::bad_network);
+    return network.value_or(network_t{});
 }
 
 std::optional<parser> prepare_parser()
 {
+    const trace_scope_t trace("prepare");
     parser p;
 
     if (!p.load_grammar(reinterpret_cast<const char *>(license_peg))) return std::nullopt;
@@ -60,10 +107,8 @@ std::optional<parser> prepare_parser()
         return expiry_t{term_length_t{sv[0].get<uint16_t>(), sv[1].get<term_length_t::units_t>()}};
     };
 
-    p["ISOYEAR"] = to_natural;
-    p["ISOMONTH"] = to_natural;
-    p["ISODAY"] = to_natural;
-    p["ISO8601"] = to_ymd_expiry;
+    // ISO8601 is fixed width, so it is decoded in one go rather than via ISOYEAR, ISOMONTH and ISODAY values
+    p["ISO8601"] = to_iso8601_expiry;
 
     p["YEAR"] = to_natural;
     p["MonthName"] = [](const SemanticValues &sv) { return static_cast<uint16_t>(sv.choice() + 1); };
@@ -79,9 +124,16 @@ std::optional<parser> prepare_parser()
         case 0:
             return license_term_t{location_t{anywhere_t{}}};
         case 1:
+        case 2:
+        case 3:
             return license_term_t{sv[0].get<location_t>()};
         }
     };
+    p["NetworkTerm"] = [](const SemanticValues &sv) { return location_t{sv[0].get<network_t>()}; };
+    p["NETWORK_ADDRESS"] = to_network;
+    p["NodePatternTerm"] = [](const SemanticValues &sv) {
+        return location_t{node_pattern_t{sv[0].get<std::string>()}};
+    };
     p["NodeTerm"] = [](const SemanticValues &sv) { return location_t{node_t{sv[0].get<std::string>()}}; };
 
     p["IdentityTerm"] = [](const SemanticValues &sv) {
@@ -98,59 +150,131 @@ std::optional<parser> prepare_parser()
     p["UserTerm"] = [](const SemanticValues &sv) { return identity_t{user_t{sv[0].get<std::string>()}}; };
     p["DomainTerm"] = [](const SemanticValues &sv) { return identity_t{domain_t{sv[0].get<std::string>()}}; };
     p["NO_SPACE_STRING"] = [](const SemanticValues &sv) { return sv.str(); };
+    p["NODE_PATTERN"] = [](const SemanticValues &sv) { return sv.token(); };
     return p;
 }
 
-std::optional<license_t> parse_license(const date::year_month_day &eval_date,
+const char *to_string(diagnostic_code_t code)
+{
+    switch (code)
+    {
+    case diagnostic_code_t::syntax_error:
+        return "syntax error";
+    case diagnostic_code_t::bad_grammar:
+        return "bad grammar";
+    case diagnostic_code_t::bad_number:
+        return "bad number";
+    case diagnostic_code_t::number_out_of_range:
+        return "number out of range";
+    case diagnostic_code_t::bad_date_format:
+        return "bad date format";
+    case diagnostic_code_t::bad_year:
+        return "bad year";
+    case diagnostic_code_t::bad_month:
+        return "bad month";
+    case diagnostic_code_t::bad_day:
+        return "bad day";
+    case diagnostic_code_t::bad_network:
+        return "bad network";
+    }
+    return "unknown error";
+}
+
+std::optional<license_t> parse_license(const peg::parser &parser,
+                                       const date::year_month_day &eval_date,
                                        std::string_view text,
                                        std::optional<std::string> const &from_file)
 {
-    if (auto parser = prepare_parser())
+    auto license = parse_license_terms(parser, text, from_file);
+    if (license) fold_license_terms(eval_date, *license);
+    return license;
+}
+
+std::optional<license_t> parse_license_terms(const peg::parser &parser,
+                                             std::string_view text,
+                                             std::optional<std::string> const &from_file)
+{
+    const trace_scope_t trace("parse");
+    const auto started = metrics_now();
+    license_t license;
+    if (!parser.parse_n(text.data(), text.size(), license, from_file.value_or("").c_str()))
     {
-        license_t license;
-        parser->parse_n(text.data(), text.size(), license, from_file.value_or("").c_str());
-        for (const auto &term : license.terms)
-        {
-            license.process_term(eval_date, term);
-        }
-        return license;
+        record_parse_failure(started, std::nullopt);
+        return std::nullopt;
     }
-    return std::nullopt;
+    record_parse(started, license.terms.size());
+    return license;
 }
 
-#if !defined(DOCTEST_CONFIG_DISABLE)
-#include "license-formatters.hpp"
+void fold_license_terms(const date::year_month_day &eval_date, license_t &license)
+{
+    const trace_scope_t trace("fold");
+    const auto started = metrics_now();
+    for (const auto &term : license.terms)
+    {
+        license.process_term(eval_date, term);
+    }
+    record_evaluation(started);
+}
 
-#include <doctest/doctest.h>
-#include <fmt/core.h>
+std::optional<license_t> parse_license(const date::year_month_day &eval_date,
+                                       std::string_view text,
+                                       std::optional<std::string> const &from_file)
+{
+    if (auto parser = prepare_parser()) return parse_license(*parser, eval_date, text, from_file);
+    return std::nullopt;
+}
 
-struct Tracer
+parse_result_t try_parse_license(const peg::parser &parser,
+                                 const date::year_month_day &eval_date,
+                                 std::string_view text,
+                                 std::optional<std::string> const &from_file)
 {
-    Tracer()
+    const auto started = metrics_now();
+    parse_result_t result;
+    any dt = &result.diagnostics;
+    license_t license;
+    const auto r = [&] {
+        const trace_scope_t trace("parse");
+        return parser["License"].parse_and_get_value(text.data(), text.size(), dt, license,
+                                                     from_file.value_or("").c_str());
+    }();
+    if (!r.ret || r.len != text.size())
     {
-        std::cout << "pos:lev\trule/ope" << std::endl;
-        std::cout << "-------\t--------" << std::endl;
+        const auto pos = !r.ret ? (r.message_pos ? r.message_pos : r.error_pos) : text.data() + r.len;
+        const auto [line, column] = line_info(text.data(), pos);
+        result.diagnostics.push_back({line, column, diagnostic_code_t::syntax_error});
     }
-    size_t prev_pos = 0;
-    void operator()(const char *name,
-                    const char *s,
-                    size_t /*n*/,
-                    const peg::SemanticValues & /*sv*/,
-                    const peg::Context &c,
-                    const peg::any & /*dt*/)
+    if (!result.diagnostics.empty())
     {
-        auto pos = static_cast<size_t>(s - c.s);
-        auto backtrack = (pos < prev_pos ? "*" : "");
-        std::string indent;
-        auto level = c.nest_level;
-        while (level--)
-        {
-            indent += "  ";
-        }
-        std::cout << pos << ":" << c.nest_level << backtrack << "\t" << indent << name << std::endl;
-        prev_pos = static_cast<size_t>(pos);
+        record_parse_failure(started, result.diagnostics.front().code);
+        return result;
     }
-};
+    record_parse(started, license.terms.size());
+
+    fold_license_terms(eval_date, license);
+    result.license = std::move(license);
+    return result;
+}
+
+parse_result_t try_parse_license(const date::year_month_day &eval_date,
+                                 std::string_view text,
+                                 std::optional<std::string> const &from_file)
+{
+    if (auto parser = prepare_parser()) return try_parse_license(*parser, eval_date, text, from_file);
+    return parse_result_t{std::nullopt, {{0, 0, diagnostic_code_t::bad_grammar}}};
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-formatters.hpp"
+
+#include "test-allocations.hpp"
+
+#include <doctest/doctest.h>
+#include <fmt/core.h>
+
+#include <fstream>
+#include <sstream>
 
 namespace peg
 {
@@ -229,6 +353,111 @@ TEST_CASE("NamedDate")
     REQUIRE(test_parse<expiry_t>(p["NamedDate"], "0 October 19"sv) == parse_failure<expiry_t>);
 }
 
+TEST_CASE("NodeTerm")
+{
+    auto p = *prepare_parser();
+    p["NodeTerm"].whitespaceOpe = p["License"].whitespaceOpe;
+    p["NodePatternTerm"].whitespaceOpe = p["License"].whitespaceOpe;
+    REQUIRE(test_parse<location_t>(p["NodeTerm"], "node=worker-0001"sv) == res_t<location_t>{node_t{"worker-0001"}});
+    REQUIRE(test_parse<location_t>(p["NodePatternTerm"], "node = worker-*"sv) ==
+            res_t<location_t>{node_pattern_t{"worker-*"}});
+    REQUIRE(test_parse<location_t>(p["NodePatternTerm"], "NODE=*.example.com"sv) ==
+            res_t<location_t>{node_pattern_t{"*.example.com"}});
+    REQUIRE(test_parse<location_t>(p["NodePatternTerm"], "node=worker-0001"sv) == parse_failure<location_t>);
+    REQUIRE(test_parse<location_t>(p["NodePatternTerm"], "node=worker-* extra"sv) == parse_failure<location_t>);
+}
+
+TEST_CASE("NetworkTerm")
+{
+    auto p = *prepare_parser();
+    p["NetworkTerm"].whitespaceOpe = p["License"].whitespaceOpe;
+    REQUIRE(test_parse<location_t>(p["NetworkTerm"], "network=10.0.0.0/8"sv) ==
+            res_t<location_t>{*parse_network("10.0.0.0/8")});
+    REQUIRE(test_parse<location_t>(p["NetworkTerm"], "Network = 2001:db8::/32"sv) ==
+            res_t<location_t>{*parse_network("2001:db8::/32")});
+    REQUIRE(test_parse<location_t>(p["NetworkTerm"], "network=192.168.1.17"sv) ==
+            res_t<location_t>{*parse_network("192.168.1.17/32")});
+    REQUIRE(test_parse<location_t>(p["NetworkTerm"], "network=10.0.0.0/33"sv) == parse_failure<location_t>);
+    REQUIRE(test_parse<location_t>(p["NetworkTerm"], "network=10.0.0/8"sv) == parse_failure<location_t>);
+    REQUIRE(test_parse<location_t>(p["NetworkTerm"], "network=cabbage"sv) == parse_failure<location_t>);
+}
+
+TEST_CASE("parse_license")
+{
+    using namespace date;
+    const auto now = 2019_y / 07 / 30;
+    const auto license = parse_license(now, "secret=abc\nexpiry=2019-12-12\nuser=stu\n"sv, std::nullopt);
+    REQUIRE(license.has_value());
+    REQUIRE(license->secret == "abc");
+    REQUIRE(license->expiry == expiry_t{2019_y / 12 / 12});
+    REQUIRE_FALSE(parse_license(now, "secret=abc\nexpiry=2019-02-30\n"sv, std::nullopt).has_value());
+    REQUIRE_FALSE(parse_license(now, "secret=abc\nexpiry=sometime\n"sv, std::nullopt).has_value());
+}
+
+TEST_CASE("try_parse_license")
+{
+    using namespace date;
+    const auto now = 2019_y / 07 / 30;
+    SUBCASE("Good license")
+    {
+        const auto result = try_parse_license(now, "secret=abc\nexpiry=2 weeks\nnode=cabbage"sv, std::nullopt);
+        REQUIRE(result.diagnostics.empty());
+        REQUIRE(result.license.has_value());
+        REQUIRE(result.license->expiry == expiry_t{term_length_t{2, term_length_t::week}});
+        REQUIRE(result.license->allowed_places == std::vector<location_t>{node_t{"cabbage"}});
+    }
+    SUBCASE("Bad values")
+    {
+        const auto result = try_parse_license(
+            now, "secret=abc\nexpiry=2019-02-30\nexpiry = 31 feb 2019\nnetwork=10.0.0.0/33\nexpiry=70000 days"sv,
+            std::nullopt);
+        REQUIRE_FALSE(result.license.has_value());
+        REQUIRE(result.diagnostics == std::vector<diagnostic_t>{{2, 8, diagnostic_code_t::bad_day},
+                                                                {3, 10, diagnostic_code_t::bad_day},
+                                                                {4, 9, diagnostic_code_t::bad_network},
+                                                                {5, 8, diagnostic_code_t::number_out_of_range}});
+    }
+    SUBCASE("Syntax error")
+    {
+        const auto result = try_parse_license(now, "secret=abc\nexpiry=2 weeks\nnode cabbage"sv, std::nullopt);
+        REQUIRE_FALSE(result.license.has_value());
+        REQUIRE(result.diagnostics == std::vector<diagnostic_t>{{3, 1, diagnostic_code_t::syntax_error}});
+    }
+}
+
+// Upper bounds with some headroom over what the parse path allocates today, so that a change which adds
+// allocations fails here rather than going unnoticed. Lower them when the path gets cheaper.
+TEST_CASE("allocation budgets")
+{
+    using namespace date;
+    const auto now = 2019_y / 07 / 30;
+    auto in = std::ifstream(LICENSE_TEST_DIR "/test.lic", std::ios::in | std::ios::binary);
+    REQUIRE(in);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    const auto text = contents.str();
+
+    SUBCASE("prepare_parser")
+    {
+        const allocation_counter_t counter;
+        const auto parser = prepare_parser();
+        const auto counts = counter.counts();
+        REQUIRE(parser.has_value());
+        REQUIRE(counts.allocations <= 66000);
+        REQUIRE(counts.bytes <= 4700000);
+    }
+    SUBCASE("parse_license")
+    {
+        const auto parser = prepare_parser();
+        const allocation_counter_t counter;
+        const auto license = parse_license(*parser, now, text, std::nullopt);
+        const auto counts = counter.counts();
+        REQUIRE(license.has_value());
+        REQUIRE(counts.allocations <= 600);
+        REQUIRE(counts.bytes <= 54000);
+    }
+}
+
 TEST_CASE("TermLength")
 {
     using namespace date;
@@ -239,5 +468,6 @@ TEST_CASE("TermLength")
     REQUIRE(test_parse<expiry_t>(p["TermLength"], "23 months"sv) == res_t<expiry_t>{expiry_t{term_length_t{23,term_length_t::month}}});
     REQUIRE(test_parse<expiry_t>(p["TermLength"], "34year"sv) == res_t<expiry_t>{expiry_t{term_length_t{34,term_length_t::year}}});
     REQUIRE(test_parse<expiry_t>(p["TermLength"], "34 yar"sv) == parse_failure<expiry_t>);
+    REQUIRE(test_parse<expiry_t>(p["TermLength"], "70000 days"sv) == parse_failure<expiry_t>);
 }
 #endif // !defined(DOCTEST_CONFIG_DISABLE)
@@ -1,14 +1,79 @@
 #ifndef LICENSE_PARSER_HPP
 #define LICENSE_PARSER_HPP
 
+#include "license-decode.hpp"
 #include "license.hpp"
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
+
+namespace peg
+{
+class parser;
+}
+
+// Builds a peglib parser for license.peg with the semantic actions that produce a license_t
+std::optional<peg::parser> prepare_parser();
 
 std::optional<license_t> parse_license(const date::year_month_day &eval_date,
                                        std::string_view text,
                                        std::optional<std::string> const &from_file);
+std::optional<license_t> parse_license(const peg::parser &parser,
+                                       const date::year_month_day &eval_date,
+                                       std::string_view text,
+                                       std::optional<std::string> const &from_file);
+
+// The two phases of parse_license: parsing the text into terms, then folding the terms into the license's fields
+std::optional<license_t> parse_license_terms(const peg::parser &parser,
+                                             std::string_view text,
+                                             std::optional<std::string> const &from_file);
+void fold_license_terms(const date::year_month_day &eval_date, license_t &license);
+
+enum class diagnostic_code_t : uint8_t
+{
+    syntax_error,
+    bad_grammar,
+    bad_number,
+    number_out_of_range,
+    bad_date_format,
+    bad_year,
+    bad_month,
+    bad_day,
+    bad_network
+};
+
+const char *to_string(diagnostic_code_t code);
+diagnostic_code_t to_diagnostic_code(decode_error_t error);
+
+struct diagnostic_t
+{
+    size_t line;
+    size_t column;
+    diagnostic_code_t code;
+};
+inline bool operator==(const diagnostic_t &l, const diagnostic_t &r)
+{
+    return l.line == r.line && l.column == r.column && l.code == r.code;
+}
+
+struct parse_result_t
+{
+    // Only set when there are no diagnostics
+    std::optional<license_t> license;
+    std::vector<diagnostic_t> diagnostics;
+};
+
+// Like parse_license, but never uses exceptions to reject bad input - every problem found is reported as a
+// diagnostic instead, which keeps batch runs over many bad files cheap
+parse_result_t try_parse_license(const date::year_month_day &eval_date,
+                                 std::string_view text,
+                                 std::optional<std::string> const &from_file);
+parse_result_t try_parse_license(const peg::parser &parser,
+                                 const date::year_month_day &eval_date,
+                                 std::string_view text,
+                                 std::optional<std::string> const &from_file);
 
 #endif /* LICENSE_PARSER_HPP */
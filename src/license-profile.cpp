@@ -0,0 +1,185 @@
+#include "license-profile.hpp"
+
+#include <algorithm>
+
+#include <fmt/core.h>
+#include <peglib.h>
+
+#include <doctest/doctest.h>
+
+grammar_profiler_t::grammar_profiler_t(peg::parser &parser) : parser(parser)
+{
+    for (auto &name : parser.get_rule_names())
+    {
+        auto &rule = parser[name.c_str()];
+        const auto index = rules.size();
+        rule.enter = [this, index](const char *s, size_t, peg::any &) { enter(index, s); };
+        rule.leave = [this, index](const char *s, size_t, size_t len, peg::any &, peg::any &) {
+            leave(index, s, len);
+        };
+        rules.push_back({std::move(name)});
+    }
+}
+
+grammar_profiler_t::~grammar_profiler_t()
+{
+    for (const auto &rule : rules)
+    {
+        parser[rule.name.c_str()].enter = nullptr;
+        parser[rule.name.c_str()].leave = nullptr;
+    }
+}
+
+std::vector<rule_profile_t> grammar_profiler_t::report() const
+{
+    std::vector<rule_profile_t> report;
+    std::copy_if(rules.begin(), rules.end(), std::back_inserter(report),
+                 [](const auto &rule) { return rule.invocations != 0; });
+    std::stable_sort(report.begin(), report.end(), [](const auto &l, const auto &r) { return l.self > r.self; });
+    return report;
+}
+
+void grammar_profiler_t::reset()
+{
+    for (auto &rule : rules)
+        rule = rule_profile_t{std::move(rule.name)};
+    stack.clear();
+    furthest = nullptr;
+}
+
+void grammar_profiler_t::enter(size_t rule, const char *s)
+{
+    // A rule entered with nothing in progress starts a new parse, perhaps of a different text
+    if (stack.empty()) furthest = s;
+    auto &profile = rules[rule];
+    ++profile.invocations;
+    if (s < furthest) ++profile.backtracks;
+    stack.push_back({rule, s, clock_t::now(), std::chrono::nanoseconds{0}});
+}
+
+void grammar_profiler_t::leave(size_t rule, const char *s, size_t len)
+{
+    // Should a rule ever be left without its callees having been left - as by a hook skipped on an exception - their
+    // frames are dropped here, rather than being charged to whatever is parsed next
+    while (!stack.empty() && (stack.back().rule != rule || stack.back().s != s))
+        stack.pop_back();
+    if (stack.empty()) return;
+    const auto frame = stack.back();
+    stack.pop_back();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - frame.entered);
+    auto &profile = rules[rule];
+    profile.total += elapsed;
+    profile.self += elapsed - frame.children;
+    if (!stack.empty()) stack.back().children += elapsed;
+    if (peg::success(len))
+    {
+        ++profile.successes;
+        furthest = std::max(furthest, s + len);
+    }
+}
+
+std::string format_profile(const std::vector<rule_profile_t> &profile)
+{
+    auto text = fmt::format("{:<20} {:>12} {:>12} {:>12} {:>12} {:>12}\n", "rule", "invocations", "successes",
+                            "backtracks", "total us", "self us");
+    for (const auto &rule : profile)
+    {
+        text += fmt::format("{:<20} {:>12} {:>12} {:>12} {:>12.1f} {:>12.1f}\n", rule.name, rule.invocations,
+                            rule.successes, rule.backtracks, rule.total.count() / 1e3, rule.self.count() / 1e3);
+    }
+    return text;
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-parser.hpp"
+
+namespace
+{
+const rule_profile_t &find_rule(const std::vector<rule_profile_t> &report, std::string_view name)
+{
+    const auto found =
+        std::find_if(report.begin(), report.end(), [&](const auto &rule) { return rule.name == name; });
+    REQUIRE(found != report.end());
+    return *found;
+}
+} // namespace
+
+TEST_CASE("grammar_profiler_t")
+{
+    auto parser = *prepare_parser();
+    const auto now = date::year_month_day{date::year{2019} / 7 / 30};
+    const auto text = std::string_view("node=web-*\nnode=db1\nexpiry=23 may 2012\n");
+    {
+        grammar_profiler_t profiler(parser);
+        for (int i = 0; i < 2; ++i)
+            REQUIRE(try_parse_license(parser, now, text, std::nullopt).license);
+
+        const auto report = profiler.report();
+        REQUIRE(std::is_sorted(report.begin(), report.end(),
+                               [](const auto &l, const auto &r) { return l.self > r.self; }));
+        for (const auto &rule : report)
+        {
+            CAPTURE(rule.name);
+            REQUIRE(rule.successes <= rule.invocations);
+            REQUIRE(rule.backtracks <= rule.invocations);
+            REQUIRE(rule.self <= rule.total);
+        }
+
+        const auto &license = find_rule(report, "License");
+        REQUIRE(license.invocations == 2);
+        REQUIRE(license.successes == 2);
+        REQUIRE(license.backtracks == 0);
+        REQUIRE(license.total >= license.self);
+
+        // Each line is a LicenseTerm, and one more is tried - and fails at NODE twice - after the final newline. The
+        // second NodePatternTerm fails after matching "node=", and NodeTerm then reads NODE again
+        const auto &term = find_rule(report, "LicenseTerm");
+        REQUIRE(term.invocations == 8);
+        REQUIRE(term.successes == 6);
+        const auto &node = find_rule(report, "NODE");
+        REQUIRE(node.invocations == 10);
+        REQUIRE(node.successes == 6);
+        REQUIRE(node.backtracks == 2);
+
+        REQUIRE(find_rule(report, "MonthName").successes == 2);
+        REQUIRE(std::none_of(report.begin(), report.end(), [](const auto &rule) { return rule.name == "DASH"; }));
+
+        profiler.reset();
+        REQUIRE(profiler.report().empty());
+    }
+
+    SUBCASE("A rule entered but never left is forgotten")
+    {
+        grammar_profiler_t profiler(parser);
+        // As though peglib had skipped a leave hook: NODE is entered again from NodeTerm's action, and never left
+        const auto action = parser["NodeTerm"].action;
+        parser["NodeTerm"] = [&](const peg::SemanticValues &sv, peg::any &dt) {
+            parser["NODE"].enter(sv.c_str(), sv.length(), dt);
+            return action(const_cast<peg::SemanticValues &>(sv), dt);
+        };
+        REQUIRE(try_parse_license(parser, now, text, std::nullopt).license);
+        parser["NodeTerm"].action = action;
+        REQUIRE(try_parse_license(parser, now, text, std::nullopt).license);
+
+        // Had the stray frame been kept, the second parse would have been taken as a backtrack within the first
+        const auto report = profiler.report();
+        const auto &license = find_rule(report, "License");
+        REQUIRE(license.invocations == 2);
+        REQUIRE(license.backtracks == 0);
+        // One backtrack in each parse, and the stray entry
+        REQUIRE(find_rule(report, "NODE").backtracks == 3);
+    }
+
+    // Once the profiler has gone, so have its hooks
+    REQUIRE(try_parse_license(parser, now, text, std::nullopt).license);
+}
+
+TEST_CASE("format_profile")
+{
+    const auto text =
+        format_profile({{"MonthName", 12, 4, 3, std::chrono::microseconds{25}, std::chrono::nanoseconds{1500}}});
+    REQUIRE(text.find("MonthName") != std::string::npos);
+    REQUIRE(text.find("25.0") != std::string::npos);
+    REQUIRE(text.find("1.5") != std::string::npos);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
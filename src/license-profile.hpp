@@ -0,0 +1,65 @@
+#ifndef LICENSE_PROFILE_HPP
+#define LICENSE_PROFILE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace peg
+{
+class parser;
+}
+
+// What one grammar rule cost over every parse made while it was being profiled
+struct rule_profile_t
+{
+    std::string name;
+    uint64_t invocations = 0;
+    uint64_t successes = 0;
+    // Invocations starting before the end of text some earlier rule had already matched, ie input read again because
+    // an alternative was abandoned
+    uint64_t backtracks = 0;
+    std::chrono::nanoseconds total{0}; // including the rules it invokes and its semantic action
+    std::chrono::nanoseconds self{0};
+};
+
+// Profiles every rule of a parser through peglib's enter and leave hooks, which this tree does not otherwise use. The
+// hooks refer to the profiler, so it must outlive every parse it sees, and it is removed from the parser on
+// destruction. A profiler counts one parse at a time: it cannot be shared by threads.
+class grammar_profiler_t
+{
+ public:
+    explicit grammar_profiler_t(peg::parser &parser);
+    grammar_profiler_t(const grammar_profiler_t &) = delete;
+    grammar_profiler_t &operator=(const grammar_profiler_t &) = delete;
+    ~grammar_profiler_t();
+
+    // Rules that were invoked, most expensive self time first
+    std::vector<rule_profile_t> report() const;
+    // Also forgets any parse left unfinished by an exception
+    void reset();
+
+ private:
+    using clock_t = std::chrono::steady_clock;
+    struct frame_t
+    {
+        size_t rule;
+        const char *s;
+        clock_t::time_point entered;
+        std::chrono::nanoseconds children;
+    };
+
+    void enter(size_t rule, const char *s);
+    void leave(size_t rule, const char *s, size_t len);
+
+    peg::parser &parser;
+    std::vector<rule_profile_t> rules;
+    std::vector<frame_t> stack;
+    const char *furthest = nullptr;
+};
+
+// A table of the report, one rule per line
+std::string format_profile(const std::vector<rule_profile_t> &profile);
+
+#endif /* LICENSE_PROFILE_HPP */
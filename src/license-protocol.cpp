@@ -0,0 +1,142 @@
+#include "license-protocol.hpp"
+
+#include <limits>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+template <class T>
+void put(std::string &out, T value)
+{
+    using U = std::make_unsigned_t<T>;
+    const auto bits = static_cast<U>(value);
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+}
+
+template <class T>
+T get(const char *in)
+{
+    using U = std::make_unsigned_t<T>;
+    U bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        bits |= static_cast<U>(static_cast<U>(static_cast<uint8_t>(in[i])) << (8 * i));
+    return static_cast<T>(bits);
+}
+} // namespace
+
+bool encode_check_request(const check_request_t &request, std::string &out)
+{
+    const auto size = check_request_header_size - 2 + request.id.size() + request.user.size() + request.node.size();
+    if (size > std::numeric_limits<uint16_t>::max()) return false;
+    put(out, static_cast<uint16_t>(size));
+    put(out, request.tag);
+    put(out, static_cast<int32_t>(request.day.time_since_epoch().count()));
+    put(out, static_cast<uint16_t>(request.id.size()));
+    put(out, static_cast<uint16_t>(request.user.size()));
+    put(out, static_cast<uint16_t>(request.node.size()));
+    out += request.id;
+    out += request.user;
+    out += request.node;
+    return true;
+}
+
+void encode_check_response(const check_response_t &response, std::string &out)
+{
+    put(out, response.tag);
+    out.push_back(static_cast<char>(response.result));
+    put(out, static_cast<int32_t>(response.expiry.time_since_epoch().count()));
+}
+
+bool check_response_holds(const check_response_t &response, date::sys_days day)
+{
+    return (day > response.expiry) == (response.result == check_result_t::expired);
+}
+
+decode_status_t decode_check_request(std::string_view in, check_request_t &request, size_t &size)
+{
+    if (in.size() < check_request_header_size) return decode_status_t::incomplete;
+    size = 2 + get<uint16_t>(in.data());
+    const auto id_size = get<uint16_t>(in.data() + 10);
+    const auto user_size = get<uint16_t>(in.data() + 12);
+    const auto node_size = get<uint16_t>(in.data() + 14);
+    if (size != check_request_header_size + id_size + user_size + node_size) return decode_status_t::malformed;
+    if (in.size() < size) return decode_status_t::incomplete;
+    request.tag = get<uint32_t>(in.data() + 2);
+    request.day = date::sys_days{date::days{get<int32_t>(in.data() + 6)}};
+    const auto *strings = in.data() + check_request_header_size;
+    request.id = {strings, id_size};
+    request.user = {strings + id_size, user_size};
+    request.node = {strings + id_size + user_size, node_size};
+    return decode_status_t::complete;
+}
+
+decode_status_t decode_check_response(std::string_view in, check_response_t &response, size_t &size)
+{
+    if (in.size() < check_response_size) return decode_status_t::incomplete;
+    const auto result = static_cast<uint8_t>(in[4]);
+    if (result >= check_result_count) return decode_status_t::malformed;
+    response.tag = get<uint32_t>(in.data());
+    response.result = static_cast<check_result_t>(result);
+    response.expiry = date::sys_days{date::days{get<int32_t>(in.data() + 5)}};
+    size = check_response_size;
+    return decode_status_t::complete;
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+TEST_CASE("check protocol")
+{
+    using namespace date;
+    std::string wire;
+    REQUIRE(encode_check_request({7, sys_days{2019_y / 7 / 30}, "team/build", "stu", "build-1"}, wire));
+    REQUIRE(encode_check_request({0xdeadbeef, sys_days{1969_y / 12 / 31}, "", "", ""}, wire));
+    REQUIRE(wire.size() == 2 * check_request_header_size + 20);
+    REQUIRE_FALSE(encode_check_request({1, {}, std::string(70000, 'x'), "", ""}, wire));
+    REQUIRE(wire.size() == 2 * check_request_header_size + 20);
+
+    check_request_t request;
+    size_t size = 0;
+    REQUIRE(decode_check_request(wire, request, size) == decode_status_t::complete);
+    REQUIRE(size == check_request_header_size + 20);
+    REQUIRE(request.tag == 7);
+    REQUIRE(request.day == sys_days{2019_y / 7 / 30});
+    REQUIRE(request.id == "team/build");
+    REQUIRE(request.user == "stu");
+    REQUIRE(request.node == "build-1");
+
+    const auto rest = std::string_view(wire).substr(size);
+    for (size_t i = 0; i < rest.size(); ++i)
+        REQUIRE(decode_check_request(rest.substr(0, i), request, size) == decode_status_t::incomplete);
+    REQUIRE(decode_check_request(rest, request, size) == decode_status_t::complete);
+    REQUIRE(request.tag == 0xdeadbeef);
+    REQUIRE(request.day == sys_days{1969_y / 12 / 31});
+    REQUIRE(request.id.empty());
+
+    // A size that disagrees with the string sizes can never become a request
+    auto bad = wire;
+    bad[0] = 1;
+    REQUIRE(decode_check_request(bad, request, size) == decode_status_t::malformed);
+
+    std::string responses;
+    const auto expiry = sys_days{2019_y / 8 / 13};
+    encode_check_response({7, check_result_t::expired, expiry}, responses);
+    encode_check_response({8, check_result_t::allowed, expiry}, responses);
+    check_response_t response;
+    REQUIRE(decode_check_response(responses, response, size) == decode_status_t::complete);
+    REQUIRE(response.tag == 7);
+    REQUIRE(response.result == check_result_t::expired);
+    REQUIRE(response.expiry == expiry);
+    REQUIRE(check_response_holds(response, expiry + days{1}));
+    REQUIRE_FALSE(check_response_holds(response, expiry));
+    REQUIRE(decode_check_response(std::string_view(responses).substr(size), response, size) ==
+            decode_status_t::complete);
+    REQUIRE(response.result == check_result_t::allowed);
+    REQUIRE(check_response_holds(response, expiry));
+    REQUIRE_FALSE(check_response_holds(response, expiry + days{1}));
+    REQUIRE(decode_check_response(std::string_view(responses).substr(size, check_response_size - 1), response,
+                                  size) == decode_status_t::incomplete);
+    responses[4] = 99;
+    REQUIRE(decode_check_response(responses, response, size) == decode_status_t::malformed);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
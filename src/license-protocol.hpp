@@ -0,0 +1,61 @@
+#ifndef LICENSE_PROTOCOL_HPP
+#define LICENSE_PROTOCOL_HPP
+
+#include "license-check.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// The binary protocol spoken by licensed. All integers are little-endian.
+//
+//   request:  u16 size of the rest | u32 tag | i32 day | u16 id size | u16 user size | u16 node size | id user node
+//   response: u32 tag | u8 check_result_t | i32 expiry
+//
+// Days count from 1970-01-01. The tag is the client's, echoed in the response. 'expiry' is the license's last valid
+// day, or the latest day for an unknown or revoked license, whose answer does not depend on the day: an expired answer
+// holds for every day after it and any other answer for every day up to it, which is what lets clients cache answers
+// (see check_response_holds).
+//
+// A client may write any number of requests without waiting; responses come back in request order, and the server
+// answers every complete request it has read before writing, so a batch of requests costs one read and one write on
+// each side.
+struct check_request_t
+{
+    uint32_t tag = 0;
+    date::sys_days day;
+    std::string_view id;
+    std::string_view user;
+    std::string_view node;
+};
+
+struct check_response_t
+{
+    uint32_t tag = 0;
+    check_result_t result = check_result_t::unknown_license;
+    date::sys_days expiry;
+};
+
+// Whether the answer in 'response' is also the answer for 'day'
+bool check_response_holds(const check_response_t &response, date::sys_days day);
+
+constexpr size_t check_request_header_size = 16;
+constexpr size_t check_response_size = 9;
+
+// Fails, appending nothing, if the request is too large to encode
+bool encode_check_request(const check_request_t &request, std::string &out);
+void encode_check_response(const check_response_t &response, std::string &out);
+
+enum class decode_status_t
+{
+    complete,
+    incomplete, // more bytes are needed
+    malformed
+};
+
+// The decoded request refers to 'in'. On success, 'size' is the number of bytes it took.
+decode_status_t decode_check_request(std::string_view in, check_request_t &request, size_t &size);
+decode_status_t decode_check_response(std::string_view in, check_response_t &response, size_t &size);
+
+#endif /* LICENSE_PROTOCOL_HPP */
@@ -0,0 +1,75 @@
+#include "license-recognizer.hpp"
+
+#include "license.peg.recognizer.hpp"
+
+#include <doctest/doctest.h>
+
+bool recognize_license(std::string_view text)
+{
+    return license_recognizer::match_License(text.data(), text.size()) == text.size();
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license.peg.hpp"
+
+#include <peglib.h>
+
+#include <string>
+
+TEST_CASE("The generated recognizer matches peglib rule by rule")
+{
+    using namespace std::literals;
+    peg::parser peglib;
+    REQUIRE(peglib.load_grammar(license_peg));
+
+    const std::string_view inputs[] = {
+        "secret = plnink plonk abb\nexpiry = 2 month\nexpiry=2019-12-12\nexpiry=23 may 2012\nanyone\nuser=stu\n"
+        "domain=methods\nanywhere\nnode=cabbage",
+        "  perpetual  \n\n",
+        "user=stu\n  \nuser=bob",
+        "network=10.0.0.0/8\nnetwork = ::1 \nnode=web-* \nnode=db1",
+        "expiry=2 Weeks\nexpiry=1days\nexpiry = 1 January 2020\nexpiry=9 SEPTEMBER2020 ",
+        "expiry=2019- 02-28",
+        "expiry=9 Sept 2020",
+        "secret=\xc3\xa9t\xc3\xa9\nnode=\xe2\x82\xac*",
+        "secret=\x80" "abc",
+        "node cabbage",
+        "",
+        "\n",
+        "2019-12-12",
+        "23 may 2012",
+        "12 decembers",
+        "September",
+        "10.0.0.0/8 ",
+        "web-*-01",
+        "anyone",
+        "ANYWHERE",
+        "perpetual",
+        "=",
+        " \t",
+        "\r\n\r\n",
+        "5 days",
+    };
+
+    for (const auto &rule : license_recognizer::rules)
+    {
+        for (const auto input : inputs)
+        {
+            CAPTURE(rule.name);
+            CAPTURE(input);
+            const auto expected = peglib[rule.name].parse(input.data(), input.size());
+            const auto len = rule.match(input.data(), input.size());
+            REQUIRE(expected.ret == (len != license_recognizer::failed));
+            if (expected.ret) REQUIRE(expected.len == len);
+        }
+    }
+}
+
+TEST_CASE("recognize_license")
+{
+    REQUIRE(recognize_license("secret=abc\nexpiry=23 may 2012\nuser=stu\n"));
+    REQUIRE(recognize_license("expiry=2019-02-30"));
+    REQUIRE_FALSE(recognize_license("secret=abc\nnode cabbage"));
+    REQUIRE_FALSE(recognize_license(""));
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
@@ -0,0 +1,11 @@
+#ifndef LICENSE_RECOGNIZER_HPP
+#define LICENSE_RECOGNIZER_HPP
+
+#include <string_view>
+
+// Whether 'text' matches license.peg, using the recognizer generated from the grammar at build time. Nothing is
+// loaded at runtime and no semantic values are built, but nor are values such as dates checked - a license that is
+// recognized can still be rejected by parse_license.
+bool recognize_license(std::string_view text);
+
+#endif /* LICENSE_RECOGNIZER_HPP */
@@ -0,0 +1,291 @@
+#include "license-revocation.hpp"
+
+#include "license-check.hpp"
+#include "license-files.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+
+#include <fmt/core.h>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+constexpr size_t max_kicks = 500;
+
+// Spreads a hash's bits, so that FNV-1a's weak low bits make good bucket numbers
+uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// 0 marks an empty slot, so no fingerprint is 0
+uint16_t fingerprint_of(uint64_t mixed)
+{
+    const auto fingerprint = static_cast<uint16_t>(mixed >> 48);
+    return fingerprint == 0 ? 1 : fingerprint;
+}
+
+// Either bucket of a fingerprint gives the other, so an entry can be moved without knowing its hash
+size_t other_bucket(size_t bucket, uint16_t fingerprint, size_t mask)
+{
+    return (bucket ^ mix(fingerprint)) & mask;
+}
+
+std::string_view trim(std::string_view text)
+{
+    const auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return {};
+    return text.substr(first, text.find_last_not_of(" \t\r") + 1 - first);
+}
+} // namespace
+
+uint64_t revocation_hash(std::string_view secret)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const auto c : secret)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+revocation_list_t::revocation_list_t(std::vector<uint64_t> hashes) : hashes(std::move(hashes))
+{
+    std::sort(this->hashes.begin(), this->hashes.end());
+    this->hashes.erase(std::unique(this->hashes.begin(), this->hashes.end()), this->hashes.end());
+
+    // Buckets are a power of two, filled to at most 90%; should an insert still fail, the filter doubles and starts
+    // again
+    size_t count = 1;
+    while (count * 4 * 9 < this->hashes.size() * 10)
+        count *= 2;
+    for (;; count *= 2)
+    {
+        buckets.assign(count, bucket_t{});
+        if (std::all_of(this->hashes.begin(), this->hashes.end(), [&](uint64_t hash) { return insert(hash); })) break;
+    }
+}
+
+bool revocation_list_t::insert(uint64_t hash)
+{
+    const auto mask = buckets.size() - 1;
+    const auto mixed = mix(hash);
+    auto fingerprint = fingerprint_of(mixed);
+    auto bucket = static_cast<size_t>(mixed) & mask;
+    for (const auto candidate : {bucket, other_bucket(bucket, fingerprint, mask)})
+    {
+        for (auto &slot : buckets[candidate])
+        {
+            if (slot != 0) continue;
+            slot = fingerprint;
+            return true;
+        }
+    }
+    // Both are full, so an entry is evicted to its other bucket, and so on. The choice of victim only has to vary.
+    for (size_t kick = 0; kick < max_kicks; ++kick)
+    {
+        std::swap(fingerprint, buckets[bucket][(mixed >> (kick % 32)) & 3]);
+        bucket = other_bucket(bucket, fingerprint, mask);
+        for (auto &slot : buckets[bucket])
+        {
+            if (slot != 0) continue;
+            slot = fingerprint;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool revocation_list_t::contains(uint64_t hash) const
+{
+    if (hashes.empty()) return false;
+    const auto mask = buckets.size() - 1;
+    const auto mixed = mix(hash);
+    const auto fingerprint = fingerprint_of(mixed);
+    const auto first = static_cast<size_t>(mixed) & mask;
+    const auto in = [&](size_t bucket) {
+        const auto &slots = buckets[bucket];
+        return slots[0] == fingerprint || slots[1] == fingerprint || slots[2] == fingerprint ||
+               slots[3] == fingerprint;
+    };
+    if (!in(first) && !in(other_bucket(first, fingerprint, mask))) return false;
+    return std::binary_search(hashes.begin(), hashes.end(), hash);
+}
+
+std::optional<revocation_list_t> parse_revocations(std::string_view text, std::string &error)
+{
+    std::vector<uint64_t> hashes;
+    size_t line_number = 0;
+    while (!text.empty())
+    {
+        ++line_number;
+        const auto end = std::min(text.find('\n'), text.size());
+        const auto line = trim(text.substr(0, end));
+        text.remove_prefix(std::min(end + 1, text.size()));
+        if (line.empty() || line.front() == '#') continue;
+
+        if (line.substr(0, 5) != "hash:")
+        {
+            hashes.push_back(revocation_hash(line));
+            continue;
+        }
+        const auto digits = trim(line.substr(5));
+        uint64_t hash = 0;
+        const auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), hash, 16);
+        if (digits.size() != 16 || ec != std::errc{} || ptr != digits.data() + digits.size())
+        {
+            error = fmt::format("{}: expected 16 hex digits", line_number);
+            return std::nullopt;
+        }
+        hashes.push_back(hash);
+    }
+    return revocation_list_t(std::move(hashes));
+}
+
+revocation_set_t::revocation_set_t()
+    : current(std::make_shared<version_t>(version_t{revocation_list_t{}, next_license_generation()})),
+      published(current->generation)
+{
+}
+
+bool revocation_set_t::reload(const std::filesystem::path &path, std::string &error)
+{
+    std::string text;
+    if (!read_file(path, text))
+    {
+        error = fmt::format("{}: cannot read file", path.string());
+        return false;
+    }
+    auto list = parse_revocations(text, error);
+    if (!list)
+    {
+        error = fmt::format("{}:{}", path.string(), error);
+        return false;
+    }
+    replace(std::move(*list));
+    return true;
+}
+
+void revocation_set_t::replace(revocation_list_t list)
+{
+    auto version = std::make_shared<const version_t>(version_t{std::move(list), next_license_generation()});
+    std::lock_guard lock(mutex);
+    current.swap(version);
+    published.store(current->generation, std::memory_order_release);
+    // The old list, if no thread still uses it, is freed once the lock is released
+}
+
+std::shared_ptr<const revocation_set_t::version_t> revocation_set_t::snapshot() const
+{
+    std::lock_guard lock(mutex);
+    return current;
+}
+
+bool revocation_set_t::revoked(std::string_view secret) const
+{
+    // Generations are never reused, so a thread's version from another set, even one since freed at the same
+    // address, never matches
+    thread_local std::shared_ptr<const version_t> cached;
+    if (!cached || cached->generation != published.load(std::memory_order_acquire)) cached = snapshot();
+    return cached->list.contains(secret);
+}
+
+size_t revocation_set_t::size() const
+{
+    return snapshot()->list.size();
+}
+
+uint64_t revocation_set_t::generation() const
+{
+    return published.load(std::memory_order_acquire);
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include <fstream>
+#include <random>
+#include <thread>
+
+TEST_CASE("revocation_list_t")
+{
+    REQUIRE(revocation_hash("") == 0xcbf29ce484222325ULL);
+    REQUIRE(revocation_hash("a") == 0xaf63dc4c8601ec8cULL);
+    REQUIRE_FALSE(revocation_list_t().contains("anything"));
+
+    // Enough entries that the filter has to move some, and misses that pass the filter go on to the table
+    std::mt19937_64 random(5);
+    std::vector<uint64_t> revoked(100000);
+    for (auto &hash : revoked)
+        hash = random();
+    const revocation_list_t list(revoked);
+    REQUIRE(list.size() == revoked.size());
+    for (const auto hash : revoked)
+        REQUIRE(list.contains(hash));
+    for (int i = 0; i < 100000; ++i)
+        REQUIRE_FALSE(list.contains(random()));
+
+    const revocation_list_t repeated({1, 1, 2});
+    REQUIRE(repeated.size() == 2);
+    REQUIRE(repeated.contains(uint64_t{1}));
+}
+
+TEST_CASE("parse_revocations")
+{
+    std::string error;
+    const auto list = parse_revocations("# revoked 2019-07-30\nabc\n  def ghi \r\n\nhash:AF63DC4C8601EC8C\n", error);
+    REQUIRE(list);
+    REQUIRE(list->size() == 3);
+    REQUIRE(list->contains("abc"));
+    REQUIRE(list->contains("def ghi"));
+    REQUIRE(list->contains("a"));
+    REQUIRE_FALSE(list->contains("ab"));
+
+    REQUIRE_FALSE(parse_revocations("abc\nhash:af63dc4c8601ec8\n", error));
+    REQUIRE(error == "2: expected 16 hex digits");
+    REQUIRE_FALSE(parse_revocations("hash:af63dc4c8601ec8g\n", error));
+}
+
+TEST_CASE("revocation_set_t")
+{
+    const auto path = std::filesystem::temp_directory_path() / "license-revocations-test";
+    std::ofstream(path) << "abc\n";
+    revocation_set_t set;
+    const auto first = set.generation();
+    REQUIRE_FALSE(set.revoked("abc"));
+    std::string error;
+    REQUIRE(set.reload(path, error));
+    REQUIRE(set.revoked("abc"));
+    REQUIRE(set.generation() > first);
+
+    // Checks go on while the list is replaced
+    std::atomic<bool> stop{false};
+    std::atomic<int> wrong{0};
+    std::thread checking([&] {
+        while (!stop)
+        {
+            if (set.revoked("xyz")) ++wrong;
+            std::this_thread::yield();
+        }
+    });
+    for (int i = 0; i < 100; ++i)
+        set.replace(revocation_list_t({revocation_hash("abc"), static_cast<uint64_t>(i)}));
+    stop = true;
+    checking.join();
+    REQUIRE(wrong == 0);
+
+    std::ofstream(path) << "hash:nope\n";
+    REQUIRE_FALSE(set.reload(path, error));
+    REQUIRE(error.find("license-revocations-test:1: expected 16 hex digits") != std::string::npos);
+    REQUIRE(set.revoked("abc"));
+    std::filesystem::remove(path);
+    REQUIRE_FALSE(set.reload(path, error));
+    REQUIRE(error.find("cannot read file") != std::string::npos);
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
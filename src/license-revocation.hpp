@@ -0,0 +1,75 @@
+#ifndef LICENSE_REVOCATION_HPP
+#define LICENSE_REVOCATION_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Revoked secrets are held as 64-bit FNV-1a hashes, so a revocation file need not contain the secrets themselves
+uint64_t revocation_hash(std::string_view secret);
+
+// A fixed set of revoked hashes. Most secrets checked are not revoked, so a lookup first asks a cuckoo filter - two
+// buckets of four 16-bit fingerprints, one or two cache misses whatever the size - which rules out all but about 1 in
+// 8000 of them. Only those that pass go on to a binary search of the sorted hashes, so the answer is exact.
+class revocation_list_t
+{
+ public:
+    revocation_list_t() = default;
+    explicit revocation_list_t(std::vector<uint64_t> hashes);
+
+    bool contains(uint64_t hash) const;
+    bool contains(std::string_view secret) const { return contains(revocation_hash(secret)); }
+    size_t size() const { return hashes.size(); }
+
+ private:
+    using bucket_t = std::array<uint16_t, 4>;
+
+    bool insert(uint64_t hash);
+
+    std::vector<uint64_t> hashes;
+    std::vector<bucket_t> buckets;
+};
+
+// A revocation file has a secret on each line, or 'hash:' and the 16 hex digits of a secret's revocation_hash. Blank
+// lines and lines starting with '#' are skipped, and so is space around an entry.
+std::optional<revocation_list_t> parse_revocations(std::string_view text, std::string &error);
+
+// The revocation list in force, which reload replaces while other threads go on checking. Each thread keeps a
+// reference to the list it last used, and takes the lock for a new one only when the published generation moves on,
+// so a check shares no cache line that anything writes to. A replaced list is freed once every thread that used it
+// has moved on to a newer one or exited.
+class revocation_set_t
+{
+ public:
+    revocation_set_t();
+
+    // Keeps the current list if the file cannot be read or parsed
+    bool reload(const std::filesystem::path &path, std::string &error);
+    void replace(revocation_list_t list);
+
+    bool revoked(std::string_view secret) const;
+    size_t size() const;
+    // Later lists have greater generations, drawn from the same sequence as license_store_t's
+    uint64_t generation() const;
+
+ private:
+    struct version_t
+    {
+        revocation_list_t list;
+        uint64_t generation;
+    };
+    std::shared_ptr<const version_t> snapshot() const;
+
+    mutable std::mutex mutex;
+    std::shared_ptr<const version_t> current;
+    std::atomic<uint64_t> published;
+};
+
+#endif /* LICENSE_REVOCATION_HPP */
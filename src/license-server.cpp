@@ -0,0 +1,371 @@
+#include "license-server.hpp"
+
+#include "license-protocol.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <doctest/doctest.h>
+
+license_server_t::license_server_t(const license_store_t &store) : store(store) {}
+
+#if defined(__linux__)
+namespace
+{
+constexpr size_t read_chunk = 65536;
+} // namespace
+
+license_server_t::~license_server_t()
+{
+    for (const auto &[fd, connection] : connections)
+        close(fd);
+    for (const auto fd : {listener, epoll, wakeup})
+    {
+        if (fd >= 0) close(fd);
+    }
+    if (listener >= 0) unlink(socket_path.c_str());
+}
+
+bool license_server_t::listen(const std::filesystem::path &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(address.sun_path)) return false;
+    std::memcpy(address.sun_path, path.c_str(), path.native().size());
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) return false;
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0)
+    {
+        close(listener);
+        listener = -1;
+        return false;
+    }
+    socket_path = path;
+
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll < 0 || wakeup < 0) return false;
+    for (const auto fd : {listener, wakeup})
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0) return false;
+    }
+    return true;
+}
+
+void license_server_t::run()
+{
+    epoll_event events[64];
+    for (;;)
+    {
+        const auto n = epoll_wait(epoll, events, static_cast<int>(std::size(events)), -1);
+        if (n < 0 && errno != EINTR) return;
+        for (int i = 0; i < n; ++i)
+        {
+            const auto fd = events[i].data.fd;
+            if (fd == wakeup) return;
+            if (fd == listener)
+            {
+                accept_connections();
+                continue;
+            }
+            const auto found = connections.find(fd);
+            if (found == connections.end()) continue;
+            auto &connection = found->second;
+            auto open = (events[i].events & EPOLLERR) == 0;
+            if (open && (events[i].events & EPOLLOUT)) open = write_responses(fd, connection);
+            if (open && (events[i].events & (EPOLLIN | EPOLLHUP))) open = read_requests(fd, connection);
+            if (!open) close_connection(fd);
+        }
+    }
+}
+
+void license_server_t::stop()
+{
+    const uint64_t one = 1;
+    [[maybe_unused]] const auto written = write(wakeup, &one, sizeof(one));
+}
+
+void license_server_t::accept_connections()
+{
+    for (;;)
+    {
+        const auto fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            continue;
+        }
+        connections.emplace(fd, connection_t{});
+    }
+}
+
+bool license_server_t::read_requests(int fd, connection_t &connection)
+{
+    auto &in = connection.in;
+    char chunk[read_chunk];
+    for (;;)
+    {
+        const auto n = read(fd, chunk, sizeof(chunk));
+        if (n > 0)
+        {
+            in.append(chunk, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0)
+        {
+            // A client that has finished writing still gets the answers to what it wrote
+            connection.finished = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+    }
+
+    size_t offset = 0;
+    check_request_t request;
+    for (size_t size = 0;; offset += size)
+    {
+        const auto status = decode_check_request(std::string_view(in).substr(offset), request, size);
+        if (status == decode_status_t::malformed) return false;
+        if (status == decode_status_t::incomplete) break;
+        const auto *license = store.find(request.id);
+        if (license && store.revoked(*license))
+            encode_check_response({request.tag, check_result_t::revoked, date::sys_days::max()}, connection.out);
+        else if (license)
+        {
+            const auto result = license->check(request.user, request.node, date::year_month_day{request.day});
+            encode_check_response({request.tag, result, date::sys_days{license->expiry}}, connection.out);
+        }
+        else
+            encode_check_response({request.tag, check_result_t::unknown_license, date::sys_days::max()},
+                                  connection.out);
+    }
+    in.erase(0, offset);
+    return write_responses(fd, connection);
+}
+
+bool license_server_t::write_responses(int fd, connection_t &connection)
+{
+    auto &out = connection.out;
+    size_t written = 0;
+    while (written < out.size())
+    {
+        const auto n = send(fd, out.data() + written, out.size() - written, MSG_NOSIGNAL);
+        if (n >= 0)
+        {
+            written += static_cast<size_t>(n);
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        break;
+    }
+    out.erase(0, written);
+    if (connection.finished && out.empty()) return false;
+
+    // While a client is not taking its responses, stop reading its requests. A finished client is never read again.
+    const auto writing = !out.empty();
+    if (writing != connection.writing)
+    {
+        epoll_event event{};
+        event.events = writing ? EPOLLOUT : EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event) != 0) return false;
+        connection.writing = writing;
+    }
+    return true;
+}
+
+void license_server_t::close_connection(int fd)
+{
+    epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+#else
+license_server_t::~license_server_t() = default;
+
+bool license_server_t::listen(const std::filesystem::path &)
+{
+    return false;
+}
+
+void license_server_t::run() {}
+
+void license_server_t::stop() {}
+
+void license_server_t::accept_connections() {}
+
+bool license_server_t::read_requests(int, connection_t &)
+{
+    return false;
+}
+
+bool license_server_t::write_responses(int, connection_t &)
+{
+    return false;
+}
+
+void license_server_t::close_connection(int) {}
+#endif
+
+#if !defined(DOCTEST_CONFIG_DISABLE) && defined(__linux__)
+#include "license-parser.hpp"
+#include "license-revocation.hpp"
+
+#include <thread>
+
+namespace
+{
+int connect_to(const std::filesystem::path &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.native().size());
+    const auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE(connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0);
+    return fd;
+}
+
+std::string read_exactly(int fd, size_t size)
+{
+    std::string in(size, '\0');
+    for (size_t got = 0; got < size;)
+    {
+        const auto n = read(fd, in.data() + got, size - got);
+        REQUIRE(n > 0);
+        got += static_cast<size_t>(n);
+    }
+    return in;
+}
+} // namespace
+
+TEST_CASE("license_server_t")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    license_store_t store;
+    store.add("build", resolved_license_t(*parse_license(issued, "secret=a\nexpiry=2 weeks\nuser=stu\nnode=build-*",
+                                                         std::nullopt),
+                                          issued));
+    revocation_set_t revocations;
+    store.use_revocations(&revocations);
+
+    const auto path = std::filesystem::temp_directory_path() / "license-server-test.sock";
+    license_server_t server(store);
+    REQUIRE(server.listen(path));
+    std::thread serving([&] { server.run(); });
+
+    const auto fd = connect_to(path);
+    SUBCASE("A batch in one write is answered in order")
+    {
+        std::string batch;
+        const auto day = sys_days{issued};
+        REQUIRE(encode_check_request({1, day, "build", "stu", "build-1"}, batch));
+        REQUIRE(encode_check_request({2, day, "build", "bob", "build-1"}, batch));
+        REQUIRE(encode_check_request({3, day + days{30}, "build", "stu", "build-1"}, batch));
+        REQUIRE(encode_check_request({4, day, "other", "stu", "build-1"}, batch));
+        REQUIRE(write(fd, batch.data(), batch.size()) == static_cast<ssize_t>(batch.size()));
+
+        const auto responses = read_exactly(fd, 4 * check_response_size);
+        const check_result_t expected[] = {check_result_t::allowed, check_result_t::user_denied,
+                                           check_result_t::expired, check_result_t::unknown_license};
+        size_t offset = 0;
+        for (uint32_t tag = 1; tag <= 4; ++tag)
+        {
+            check_response_t response;
+            size_t size = 0;
+            REQUIRE(decode_check_response(std::string_view(responses).substr(offset), response, size) ==
+                    decode_status_t::complete);
+            REQUIRE(response.tag == tag);
+            REQUIRE(response.result == expected[tag - 1]);
+            offset += size;
+        }
+    }
+    SUBCASE("A request split across writes is answered once it is complete")
+    {
+        std::string request;
+        REQUIRE(encode_check_request({9, sys_days{issued}, "build", "stu", "build-2"}, request));
+        REQUIRE(write(fd, request.data(), 5) == 5);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(write(fd, request.data() + 5, request.size() - 5) == static_cast<ssize_t>(request.size() - 5));
+
+        check_response_t response;
+        size_t size = 0;
+        REQUIRE(decode_check_response(read_exactly(fd, check_response_size), response, size) ==
+                decode_status_t::complete);
+        REQUIRE(response.tag == 9);
+        REQUIRE(response.result == check_result_t::allowed);
+    }
+    SUBCASE("A license revoked while serving is refused")
+    {
+        revocations.replace(revocation_list_t({revocation_hash("a")}));
+        std::string request;
+        REQUIRE(encode_check_request({5, sys_days{issued}, "build", "stu", "build-1"}, request));
+        REQUIRE(write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+
+        check_response_t response;
+        size_t size = 0;
+        REQUIRE(decode_check_response(read_exactly(fd, check_response_size), response, size) ==
+                decode_status_t::complete);
+        REQUIRE(response.result == check_result_t::revoked);
+    }
+    SUBCASE("A client that shuts down its side gets every answer before the connection closes")
+    {
+        // Far more responses than the socket buffers hold, so most are still queued when the client stops writing
+        constexpr size_t count = 100000;
+        std::string batch;
+        for (uint32_t tag = 0; tag < count; ++tag)
+            encode_check_request({tag, sys_days{issued}, "build", "stu", "build-1"}, batch);
+        REQUIRE(batch.size() > count * check_request_header_size);
+        std::thread writing([&] {
+            for (size_t written = 0; written < batch.size();)
+            {
+                const auto n = write(fd, batch.data() + written, batch.size() - written);
+                if (n <= 0) return;
+                written += static_cast<size_t>(n);
+            }
+            shutdown(fd, SHUT_WR);
+        });
+        const auto responses = read_exactly(fd, count * check_response_size);
+        writing.join();
+        check_response_t response;
+        size_t size = 0;
+        REQUIRE(decode_check_response(std::string_view(responses).substr(responses.size() - check_response_size),
+                                      response, size) == decode_status_t::complete);
+        REQUIRE(response.tag == count - 1);
+        char byte;
+        REQUIRE(read(fd, &byte, 1) == 0);
+    }
+    SUBCASE("A malformed request closes the connection")
+    {
+        const char garbage[check_request_header_size] = {1};
+        REQUIRE(write(fd, garbage, sizeof(garbage)) == static_cast<ssize_t>(sizeof(garbage)));
+        char byte;
+        REQUIRE(read(fd, &byte, 1) == 0);
+    }
+
+    close(fd);
+    server.stop();
+    serving.join();
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE) && defined(__linux__)
@@ -0,0 +1,51 @@
+#ifndef LICENSE_SERVER_HPP
+#define LICENSE_SERVER_HPP
+
+#include "license-check.hpp"
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+// Answers check requests (see license-protocol.hpp) on a Unix domain socket from one epoll event loop. Every complete
+// request read from a connection is answered before any response is written, so pipelined and batched requests cost
+// one read and one write each. Linux only: elsewhere listen always fails.
+class license_server_t
+{
+ public:
+    explicit license_server_t(const license_store_t &store);
+    license_server_t(const license_server_t &) = delete;
+    license_server_t &operator=(const license_server_t &) = delete;
+    ~license_server_t();
+
+    // Replaces anything already at 'socket_path'
+    bool listen(const std::filesystem::path &socket_path);
+    // Serves until stop is called
+    void run();
+    // May be called from any thread, or from a signal handler
+    void stop();
+
+ private:
+    struct connection_t
+    {
+        std::string in;
+        std::string out;
+        bool writing = false;  // waiting for the socket to take the rest of 'out'
+        bool finished = false; // the client has shut down its side, and is closed once 'out' is sent
+    };
+
+    void accept_connections();
+    // False once the connection should be closed
+    bool read_requests(int fd, connection_t &connection);
+    bool write_responses(int fd, connection_t &connection);
+    void close_connection(int fd);
+
+    const license_store_t &store;
+    std::filesystem::path socket_path;
+    int listener = -1;
+    int epoll = -1;
+    int wakeup = -1;
+    std::unordered_map<int, connection_t> connections;
+};
+
+#endif /* LICENSE_SERVER_HPP */
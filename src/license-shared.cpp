@@ -0,0 +1,585 @@
+#include "license-shared.hpp"
+
+#include "overloaded.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <optional>
+#include <thread>
+#endif
+
+#include <doctest/doctest.h>
+
+namespace
+{
+constexpr uint32_t image_magic = 0x3143494c; // "LIC1"
+
+struct image_header_t
+{
+    uint32_t magic;
+    uint32_t license_count;
+    uint32_t term_count;
+    uint32_t strings_size;
+};
+
+// Strings are offsets into the string area at the end of the image
+struct license_record_t
+{
+    uint32_t id;
+    uint32_t id_size;
+    uint32_t secret;
+    uint32_t secret_size;
+    int32_t expiry; // days from 1970-01-01
+    uint32_t first_term;
+    uint32_t term_count;
+};
+
+enum class term_kind_t : uint8_t
+{
+    anyone,
+    user,
+    domain,
+    anywhere,
+    node,
+    node_pattern,
+    network
+};
+
+struct term_record_t
+{
+    term_kind_t kind;
+    uint8_t prefix_length;
+    uint16_t reserved;
+    uint32_t text;
+    uint32_t text_size;
+    ip_address_t address;
+};
+
+static_assert(std::is_trivially_copyable_v<license_record_t> && std::is_trivially_copyable_v<term_record_t>);
+
+template <class T>
+void append(std::string &image, const std::vector<T> &records)
+{
+    image.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(T));
+}
+
+template <class T>
+T record_at(std::string_view image, size_t offset)
+{
+    T record;
+    std::memcpy(&record, image.data() + offset, sizeof(T));
+    return record;
+}
+
+// Lays out records and the strings they refer to
+class image_builder_t
+{
+ public:
+    uint32_t add_string(std::string_view text)
+    {
+        const auto offset = static_cast<uint32_t>(strings.size());
+        strings += text;
+        return offset;
+    }
+
+    void add_term(term_kind_t kind, std::string_view text)
+    {
+        terms.push_back({kind, 0, 0, add_string(text), static_cast<uint32_t>(text.size()), {}});
+    }
+
+    void add_term(const identity_t &identity)
+    {
+        std::visit(overloaded{[&](const anyone_t &) { add_term(term_kind_t::anyone, {}); },
+                              [&](const user_t &user) { add_term(term_kind_t::user, user.get()); },
+                              [&](const domain_t &domain) { add_term(term_kind_t::domain, domain.get()); }},
+                   identity);
+    }
+
+    void add_term(const location_t &location)
+    {
+        std::visit(overloaded{[&](const anywhere_t &) { add_term(term_kind_t::anywhere, {}); },
+                              [&](const node_t &node) { add_term(term_kind_t::node, node.get()); },
+                              [&](const node_pattern_t &pattern) {
+                                  add_term(term_kind_t::node_pattern, pattern.get());
+                              },
+                              [&](const network_t &network) {
+                                  terms.push_back({term_kind_t::network, network.prefix_length, 0, 0, 0,
+                                                   network.address});
+                              }},
+                   location);
+    }
+
+    void add_license(const loaded_license_t &loaded, const date::year_month_day &issue_date)
+    {
+        const auto &license = loaded.license;
+        const auto first_term = static_cast<uint32_t>(terms.size());
+        for (const auto &identity : license.allowed_users)
+            add_term(identity);
+        for (const auto &location : license.allowed_places)
+            add_term(location);
+        const auto expiry = date::sys_days{resolve_expiry(issue_date, license)};
+        licenses.push_back({add_string(loaded.id), static_cast<uint32_t>(loaded.id.size()),
+                            add_string(license.secret), static_cast<uint32_t>(license.secret.size()),
+                            static_cast<int32_t>(expiry.time_since_epoch().count()), first_term,
+                            static_cast<uint32_t>(terms.size()) - first_term});
+    }
+
+    std::string build() const
+    {
+        const image_header_t header{image_magic, static_cast<uint32_t>(licenses.size()),
+                                    static_cast<uint32_t>(terms.size()), static_cast<uint32_t>(strings.size())};
+        std::string image(reinterpret_cast<const char *>(&header), sizeof(header));
+        append(image, licenses);
+        append(image, terms);
+        return image += strings;
+    }
+
+ private:
+    std::vector<license_record_t> licenses;
+    std::vector<term_record_t> terms;
+    std::string strings;
+};
+} // namespace
+
+std::string encode_license_image(const std::vector<loaded_license_t> &licenses, const date::year_month_day &issue_date)
+{
+    image_builder_t builder;
+    for (const auto &loaded : licenses)
+        builder.add_license(loaded, issue_date);
+    return builder.build();
+}
+
+bool decode_license_image(std::string_view image, license_store_t &store)
+{
+    if (image.size() < sizeof(image_header_t)) return false;
+    const auto header = record_at<image_header_t>(image, 0);
+    const auto licenses_offset = uint64_t{sizeof(image_header_t)};
+    const auto terms_offset = licenses_offset + uint64_t{header.license_count} * sizeof(license_record_t);
+    const auto strings_offset = terms_offset + uint64_t{header.term_count} * sizeof(term_record_t);
+    if (header.magic != image_magic || strings_offset + header.strings_size != image.size()) return false;
+
+    const auto strings = image.substr(strings_offset);
+    auto string_at = [&](uint32_t offset, uint32_t size, std::string_view &text) {
+        if (uint64_t{offset} + size > strings.size()) return false;
+        text = strings.substr(offset, size);
+        return true;
+    };
+    std::string_view id;
+    std::string_view secret;
+    std::string_view text;
+    for (uint32_t i = 0; i < header.license_count; ++i)
+    {
+        const auto record = record_at<license_record_t>(image, licenses_offset + i * sizeof(license_record_t));
+        if (!string_at(record.id, record.id_size, id) || !string_at(record.secret, record.secret_size, secret) ||
+            uint64_t{record.first_term} + record.term_count > header.term_count)
+            return false;
+
+        const auto expiry = date::year_month_day{date::sys_days{date::days{record.expiry}}};
+        license_t license;
+        license.secret = secret;
+        license.expiry = expiry;
+        for (auto t = record.first_term; t < record.first_term + record.term_count; ++t)
+        {
+            const auto term = record_at<term_record_t>(image, terms_offset + t * sizeof(term_record_t));
+            if (!string_at(term.text, term.text_size, text)) return false;
+            switch (term.kind)
+            {
+            case term_kind_t::anyone:
+                license.allowed_users.emplace_back(anyone_t{});
+                break;
+            case term_kind_t::user:
+                license.allowed_users.emplace_back(user_t{std::string(text)});
+                break;
+            case term_kind_t::domain:
+                license.allowed_users.emplace_back(domain_t{std::string(text)});
+                break;
+            case term_kind_t::anywhere:
+                license.allowed_places.emplace_back(anywhere_t{});
+                break;
+            case term_kind_t::node:
+                license.allowed_places.emplace_back(node_t{std::string(text)});
+                break;
+            case term_kind_t::node_pattern:
+                license.allowed_places.emplace_back(node_pattern_t{std::string(text)});
+                break;
+            case term_kind_t::network:
+                license.allowed_places.emplace_back(network_t{term.address, term.prefix_length});
+                break;
+            default:
+                return false;
+            }
+        }
+        // The expiry is already a day, so the issue date makes no difference
+        store.add(std::string(id), resolved_license_t(license, expiry));
+    }
+    return true;
+}
+
+bool attach_shared_licenses(const std::string &name, license_store_t &store)
+{
+    shared_license_reader_t reader(name);
+    std::string image;
+    uint64_t generation = 0;
+    return reader.read(image, generation) && decode_license_image(image, store);
+}
+
+#if defined(__linux__)
+namespace
+{
+struct segment_header_t
+{
+    uint32_t magic;
+    uint32_t reserved;
+    // Odd while the publisher is writing; twice the number of publications otherwise
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> image_size;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence is shared between processes");
+
+constexpr uint32_t segment_magic = 0x5348434c; // "LCHS"
+// How long a reader waits for a publisher to finish writing before giving up, as one that died mid-publish never will
+constexpr auto publish_patience = std::chrono::milliseconds(250);
+// The image starts on its own cache line, away from the sequence readers poll
+constexpr size_t image_offset = 64;
+
+segment_header_t &segment_header(void *mapping)
+{
+    return *static_cast<segment_header_t *>(mapping);
+}
+
+char *segment_image(void *mapping)
+{
+    return static_cast<char *>(mapping) + image_offset;
+}
+} // namespace
+
+shared_license_publisher_t::shared_license_publisher_t(std::string name) : name(std::move(name))
+{
+    // The image holds every license's secret, so only the publisher's user may read it
+    fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+}
+
+shared_license_publisher_t::~shared_license_publisher_t()
+{
+    if (mapping) munmap(mapping, mapped_size);
+    if (fd >= 0) close(fd);
+}
+
+bool shared_license_publisher_t::reserve(size_t size)
+{
+    const auto needed = image_offset + size;
+    if (needed <= mapped_size) return true;
+    struct stat status;
+    if (fstat(fd, &status) != 0) return false;
+    // Segments only grow, so a reader's mapping always covers the images it saw the size of
+    auto reserved = std::max<size_t>(static_cast<size_t>(status.st_size), 4096);
+    while (reserved < needed)
+        reserved *= 2;
+    if (reserved > static_cast<size_t>(status.st_size) && ftruncate(fd, static_cast<off_t>(reserved)) != 0)
+        return false;
+    if (mapping) munmap(mapping, mapped_size);
+    mapping = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        mapped_size = 0;
+        return false;
+    }
+    mapped_size = reserved;
+    segment_header(mapping).magic = segment_magic;
+    return true;
+}
+
+bool shared_license_publisher_t::publish(std::string_view image)
+{
+    if (fd < 0 || !reserve(image.size())) return false;
+    auto &header = segment_header(mapping);
+    // A publisher that died while writing left the sequence odd. Counting on from the next even number, without ever
+    // storing it, keeps the half-written image from looking whole.
+    auto sequence = header.sequence.load(std::memory_order_relaxed);
+    sequence += sequence & 1;
+    header.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(segment_image(mapping), image.data(), image.size());
+    header.image_size.store(image.size(), std::memory_order_relaxed);
+    header.sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+void shared_license_publisher_t::remove()
+{
+    shm_unlink(name.c_str());
+}
+
+shared_license_reader_t::shared_license_reader_t(std::string name) : name(std::move(name)) {}
+
+shared_license_reader_t::~shared_license_reader_t()
+{
+    if (mapping) munmap(mapping, mapped_size);
+    if (fd >= 0) close(fd);
+}
+
+bool shared_license_reader_t::attach()
+{
+    if (mapping) return true;
+    if (fd < 0) fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    return fd >= 0 && remap();
+}
+
+bool shared_license_reader_t::remap()
+{
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < image_offset) return false;
+    if (mapping) munmap(mapping, mapped_size);
+    mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        mapped_size = 0;
+        return false;
+    }
+    mapped_size = static_cast<size_t>(status.st_size);
+    return segment_header(mapping).magic == segment_magic;
+}
+
+uint64_t shared_license_reader_t::generation()
+{
+    if (!attach()) return 0;
+    return segment_header(mapping).sequence.load(std::memory_order_acquire) / 2;
+}
+
+bool shared_license_reader_t::read(std::string &image, uint64_t &generation)
+{
+    if (!attach()) return false;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    for (;;)
+    {
+        auto &header = segment_header(mapping);
+        const auto before = header.sequence.load(std::memory_order_acquire);
+        if (before == 0) return false;
+        if (before % 2 != 0)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (!deadline) deadline = now + publish_patience;
+            if (now > *deadline) return false;
+            std::this_thread::yield();
+            continue;
+        }
+        const auto size = header.image_size.load(std::memory_order_relaxed);
+        if (image_offset + size > mapped_size)
+        {
+            // The publisher grew the segment for a larger image
+            if (!remap()) return false;
+            continue;
+        }
+        image.assign(segment_image(mapping), size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequence.load(std::memory_order_relaxed) == before)
+        {
+            generation = before / 2;
+            return true;
+        }
+    }
+}
+#else
+shared_license_publisher_t::shared_license_publisher_t(std::string name) : name(std::move(name)) {}
+
+shared_license_publisher_t::~shared_license_publisher_t() = default;
+
+bool shared_license_publisher_t::reserve(size_t)
+{
+    return false;
+}
+
+bool shared_license_publisher_t::publish(std::string_view)
+{
+    return false;
+}
+
+void shared_license_publisher_t::remove() {}
+
+shared_license_reader_t::shared_license_reader_t(std::string name) : name(std::move(name)) {}
+
+shared_license_reader_t::~shared_license_reader_t() = default;
+
+bool shared_license_reader_t::attach()
+{
+    return false;
+}
+
+bool shared_license_reader_t::remap()
+{
+    return false;
+}
+
+uint64_t shared_license_reader_t::generation()
+{
+    return 0;
+}
+
+bool shared_license_reader_t::read(std::string &, uint64_t &)
+{
+    return false;
+}
+#endif
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-parser.hpp"
+
+namespace
+{
+std::vector<loaded_license_t> shared_test_licenses(const date::year_month_day &issued, size_t extra = 0)
+{
+    std::vector<loaded_license_t> licenses;
+    licenses.push_back({"site", *parse_license(issued, "secret=site\nanyone\nanywhere", std::nullopt)});
+    licenses.push_back({"team/build",
+                        *parse_license(issued,
+                                       "secret=build\nexpiry=2 weeks\nuser=stu\ndomain=eng.example.com\n"
+                                       "node=build-*\nnode=release\nnetwork=10.1.0.0/16\nnetwork=fd00::/8",
+                                       std::nullopt)});
+    const auto extra_license = *parse_license(issued, "secret=x\nuser=u", std::nullopt);
+    for (size_t i = 0; i < extra; ++i)
+        licenses.push_back({"extra/" + std::to_string(i), extra_license});
+    return licenses;
+}
+
+void check_shared_test_store(const license_store_t &store)
+{
+    using namespace date;
+    REQUIRE(store.find("site")->secret == "site");
+    REQUIRE(store.find("team/build")->expiry == 2019_y / 8 / 13);
+    REQUIRE(store.check("site", "anyone", "anything", 2030_y / 1 / 1) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "stu", "build-1", 2019_y / 8 / 13) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "alice@eng.example.com", "release", 2019_y / 8 / 1) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "stu", "10.1.9.9", 2019_y / 8 / 1) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "stu", "fd12::1", 2019_y / 8 / 1) == check_result_t::allowed);
+    REQUIRE(store.check("team/build", "stu", "10.2.0.1", 2019_y / 8 / 1) == check_result_t::node_denied);
+    REQUIRE(store.check("team/build", "bob", "build-1", 2019_y / 8 / 1) == check_result_t::user_denied);
+    REQUIRE(store.check("team/build", "stu", "build-1", 2019_y / 8 / 14) == check_result_t::expired);
+}
+} // namespace
+
+TEST_CASE("license images")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    const auto image = encode_license_image(shared_test_licenses(issued), issued);
+
+    license_store_t store;
+    REQUIRE(decode_license_image(image, store));
+    REQUIRE(store.size() == 2);
+    check_shared_test_store(store);
+
+    for (size_t size = 0; size < image.size(); ++size)
+    {
+        license_store_t partial;
+        REQUIRE_FALSE(decode_license_image(std::string_view(image).substr(0, size), partial));
+    }
+    auto bad = image;
+    bad[sizeof(image_header_t) + 2 * sizeof(license_record_t)] = 99;
+    REQUIRE_FALSE(decode_license_image(bad, store));
+
+    // A past fixed date stays the expiry, whatever term length goes with it
+    std::vector<loaded_license_t> past;
+    past.push_back({"past", *parse_license(issued, "secret=p\nexpiry=2019-01-01\nexpiry=1 month", std::nullopt)});
+    license_store_t past_store;
+    REQUIRE(decode_license_image(encode_license_image(past, issued), past_store));
+    REQUIRE(past_store.find("past")->expiry == 2019_y / 1 / 1);
+    REQUIRE(past_store.check("past", "anyone", "anything", issued) == check_result_t::expired);
+}
+
+#if defined(__linux__)
+TEST_CASE("shared license tables")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    const std::string name = "/license-shared-test";
+    shm_unlink(name.c_str());
+
+    license_store_t store;
+    REQUIRE_FALSE(attach_shared_licenses(name, store));
+    shared_license_publisher_t publisher(name);
+    shared_license_reader_t reader(name);
+    REQUIRE(reader.generation() == 0);
+    REQUIRE_FALSE(attach_shared_licenses(name, store));
+
+    const auto small = encode_license_image(shared_test_licenses(issued), issued);
+    REQUIRE(publisher.publish(small));
+    REQUIRE(reader.generation() == 1);
+    REQUIRE(attach_shared_licenses(name, store));
+    check_shared_test_store(store);
+
+    SUBCASE("A reader follows the segment as it grows")
+    {
+        const auto large = encode_license_image(shared_test_licenses(issued, 1000), issued);
+        REQUIRE(large.size() > 8192);
+        REQUIRE(publisher.publish(large));
+        std::string image;
+        uint64_t generation = 0;
+        REQUIRE(reader.read(image, generation));
+        REQUIRE(generation == 2);
+        REQUIRE(image == large);
+    }
+    SUBCASE("Readers only ever see whole images")
+    {
+        const auto large = encode_license_image(shared_test_licenses(issued, 100), issued);
+        std::atomic<bool> done{false};
+        std::thread publishing([&] {
+            for (int i = 0; i < 500; ++i)
+                publisher.publish(i % 2 ? small : large);
+            done = true;
+        });
+        std::string image;
+        uint64_t generation = 0;
+        uint64_t last = 0;
+        while (!done)
+        {
+            REQUIRE(reader.read(image, generation));
+            REQUIRE((image == small || image == large));
+            REQUIRE(generation >= last);
+            last = generation;
+            std::this_thread::yield();
+        }
+        publishing.join();
+        REQUIRE(reader.generation() == 501);
+    }
+    SUBCASE("A publisher that died while writing is recovered from")
+    {
+        // As if the publisher stopped between marking the segment and copying the image
+        const auto fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        REQUIRE(fd >= 0);
+        auto *mapping = mmap(nullptr, image_offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        REQUIRE(mapping != MAP_FAILED);
+        segment_header(mapping).sequence.store(3);
+        std::string image;
+        uint64_t generation = 0;
+        REQUIRE_FALSE(reader.read(image, generation));
+
+        shared_license_publisher_t restarted(name);
+        const auto large = encode_license_image(shared_test_licenses(issued, 10), issued);
+        REQUIRE(restarted.publish(large));
+        REQUIRE(segment_header(mapping).sequence.load() == 6);
+        REQUIRE(reader.read(image, generation));
+        REQUIRE(generation == 3);
+        REQUIRE(image == large);
+        // Only the owner can read the secrets in it
+        struct stat status;
+        REQUIRE(fstat(fd, &status) == 0);
+        REQUIRE((status.st_mode & 0777) == 0600);
+        munmap(mapping, image_offset);
+        close(fd);
+    }
+    publisher.remove();
+}
+#endif
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
@@ -0,0 +1,79 @@
+#ifndef LICENSE_SHARED_HPP
+#define LICENSE_SHARED_HPP
+
+#include "license-check.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A resolved license set in shared memory, so that the processes on a host parse their licenses once between them.
+// One loader publishes an image of the set; any number of readers copy out the latest image and rebuild a store from
+// it, which builds each license's matchers but parses nothing.
+
+// An image holds each license's ID, secret, resolved expiry and identity and location terms. It refers to its strings
+// by offset, never by pointer, so it means the same at any address. It carries no revocations: a store built from an
+// image refuses nothing until it is given a revocation_set_t, loaded from the same file as the publisher's (see
+// license_store_t::use_revocations).
+std::string encode_license_image(const std::vector<loaded_license_t> &licenses, const date::year_month_day &issue_date);
+// False, leaving 'store' partly filled, if the image is malformed
+bool decode_license_image(std::string_view image, license_store_t &store);
+
+// The segment starts with a sequence number that is odd while the publisher is writing, so a reader that sees the
+// same even number before and after copying the image knows it has a whole one (a seqlock). Readers never block the
+// publisher. The image holds the licenses' secrets, so the segment is created readable and writable by its owner only
+// (mode 0600): readers must run as the publisher's user. POSIX shared memory on Linux only: elsewhere publishing and
+// reading always fail.
+class shared_license_publisher_t
+{
+ public:
+    // 'name' is a POSIX shared memory name, eg '/licensed'
+    explicit shared_license_publisher_t(std::string name);
+    shared_license_publisher_t(const shared_license_publisher_t &) = delete;
+    shared_license_publisher_t &operator=(const shared_license_publisher_t &) = delete;
+    // Leaves the segment for readers; see remove
+    ~shared_license_publisher_t();
+
+    bool publish(std::string_view image);
+    // Removes the segment's name; processes that have it mapped keep their mapping
+    void remove();
+
+ private:
+    bool reserve(size_t size);
+
+    std::string name;
+    int fd = -1;
+    void *mapping = nullptr;
+    size_t mapped_size = 0;
+};
+
+class shared_license_reader_t
+{
+ public:
+    explicit shared_license_reader_t(std::string name);
+    shared_license_reader_t(const shared_license_reader_t &) = delete;
+    shared_license_reader_t &operator=(const shared_license_reader_t &) = delete;
+    ~shared_license_reader_t();
+
+    // Counts publications, so a reader can tell cheaply whether there is a new image; 0 before the first
+    uint64_t generation();
+    // Copies the latest image. False if the segment does not exist, nothing has been published, or a publish has been
+    // under way too long - as when the publisher died while writing.
+    bool read(std::string &image, uint64_t &generation);
+
+ private:
+    bool attach();
+    bool remap();
+
+    std::string name;
+    int fd = -1;
+    void *mapping = nullptr;
+    size_t mapped_size = 0;
+};
+
+// Reads and decodes the latest image published under 'name'
+bool attach_shared_licenses(const std::string &name, license_store_t &store);
+
+#endif /* LICENSE_SHARED_HPP */
@@ -0,0 +1,190 @@
+#include "license-trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+struct event_t
+{
+    const char *name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+};
+
+struct thread_buffer_t
+{
+    uint32_t tid;
+    std::vector<event_t> events;
+    uint64_t recorded = 0; // including any the ring has since overwritten
+};
+
+struct registry_t
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<thread_buffer_t>> buffers;
+    size_t capacity = 0;
+    uint64_t generation = 0;
+    std::chrono::steady_clock::time_point origin;
+};
+
+registry_t &registry()
+{
+    static registry_t r;
+    return r;
+}
+
+// A buffer for the calling thread's events in the current trace, and the trace's generation
+std::pair<thread_buffer_t *, uint64_t> new_thread_buffer()
+{
+    auto &r = registry();
+    std::lock_guard lock(r.mutex);
+    r.buffers.push_back(std::make_unique<thread_buffer_t>());
+    auto *buffer = r.buffers.back().get();
+    buffer->tid = static_cast<uint32_t>(r.buffers.size());
+    buffer->events.resize(r.capacity);
+    return {buffer, r.generation};
+}
+} // namespace
+
+namespace trace_detail
+{
+std::atomic<bool> enabled{false};
+
+uint64_t now_ns()
+{
+    const auto elapsed = std::chrono::steady_clock::now() - registry().origin;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void record(const char *name, uint64_t begin_ns, uint64_t end_ns)
+{
+    // Only a thread's first event in each trace takes the lock
+    thread_local thread_buffer_t *buffer = nullptr;
+    thread_local uint64_t generation = 0;
+    if (!buffer || generation != registry().generation) std::tie(buffer, generation) = new_thread_buffer();
+    buffer->events[buffer->recorded++ % buffer->events.size()] = {name, begin_ns, end_ns};
+}
+} // namespace trace_detail
+
+void enable_tracing(size_t events_per_thread)
+{
+    auto &r = registry();
+    {
+        std::lock_guard lock(r.mutex);
+        r.buffers.clear();
+        r.capacity = std::max<size_t>(events_per_thread, 1);
+        ++r.generation;
+        r.origin = std::chrono::steady_clock::now();
+    }
+    trace_detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void disable_tracing()
+{
+    trace_detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+std::string format_trace()
+{
+    auto &r = registry();
+    std::lock_guard lock(r.mutex);
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    const char *separator = "\n";
+    for (const auto &buffer : r.buffers)
+    {
+        const auto thread_name = fmt::format("{{\"name\":\"thread {}\"}}", buffer->tid);
+        json += fmt::format("{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{}}}", separator,
+                            buffer->tid, thread_name);
+        separator = ",\n";
+        const auto size = buffer->events.size();
+        const auto first = buffer->recorded > size ? buffer->recorded - size : 0;
+        for (auto i = first; i < buffer->recorded; ++i)
+        {
+            const auto &event = buffer->events[i % size];
+            json += fmt::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                                event.name, buffer->tid, event.begin_ns / 1e3,
+                                (event.end_ns - event.begin_ns) / 1e3);
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+bool write_trace(const std::filesystem::path &path)
+{
+    const auto json = format_trace();
+    auto out = std::ofstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    return out && out.write(json.data(), static_cast<std::streamsize>(json.size()));
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include <thread>
+
+namespace
+{
+size_t count(const std::string &text, std::string_view what)
+{
+    size_t n = 0;
+    for (auto pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + what.size()))
+        ++n;
+    return n;
+}
+} // namespace
+
+TEST_CASE("tracing")
+{
+    SUBCASE("Disabled")
+    {
+        enable_tracing();
+        disable_tracing();
+        {
+            const trace_scope_t scope("parse");
+        }
+        REQUIRE(count(format_trace(), "\"ph\":\"X\"") == 0);
+    }
+    SUBCASE("Threads")
+    {
+        enable_tracing();
+        auto work = [] {
+            const trace_scope_t outer("read");
+            const trace_scope_t inner("parse");
+        };
+        std::thread other(work);
+        other.join();
+        work();
+        disable_tracing();
+
+        const auto json = format_trace();
+        REQUIRE(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0) == 0);
+        REQUIRE(json.substr(json.size() - 3) == "]}\n");
+        REQUIRE(count(json, "\"ph\":\"M\"") == 2);
+        REQUIRE(count(json, "{\"name\":\"read\",\"ph\":\"X\"") == 2);
+        REQUIRE(count(json, "{\"name\":\"parse\",\"ph\":\"X\",\"pid\":1,\"tid\":1,") == 1);
+        REQUIRE(count(json, "{\"name\":\"parse\",\"ph\":\"X\",\"pid\":1,\"tid\":2,") == 1);
+    }
+    SUBCASE("A full ring keeps the latest events")
+    {
+        enable_tracing(4);
+        const char *names[] = {"a", "b", "c", "d", "e", "f"};
+        for (const auto name : names)
+            const trace_scope_t scope(name);
+        disable_tracing();
+
+        const auto json = format_trace();
+        REQUIRE(count(json, "\"ph\":\"X\"") == 4);
+        REQUIRE(count(json, "\"name\":\"b\"") == 0);
+        REQUIRE(json.find("\"name\":\"c\"") < json.find("\"name\":\"f\""));
+    }
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
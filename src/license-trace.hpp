@@ -0,0 +1,56 @@
+#ifndef LICENSE_TRACE_HPP
+#define LICENSE_TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// An optional timeline of where batch runs spend their time. While tracing is enabled, each trace_scope_t records one
+// event, holding its begin and end times, into a ring buffer belonging to the calling thread, so a long run keeps its
+// most recent events. The timeline is written as Chrome Trace Event JSON, which Perfetto and chrome://tracing open.
+//
+// Enabling, disabling and writing the trace must not overlap any traced work: call them before starting worker
+// threads, or after joining them. While tracing is disabled, a trace_scope_t costs one relaxed load.
+
+namespace trace_detail
+{
+extern std::atomic<bool> enabled;
+void record(const char *name, uint64_t begin_ns, uint64_t end_ns);
+uint64_t now_ns();
+} // namespace trace_detail
+
+// Discards any earlier trace. Each thread keeps its latest 'events_per_thread' events.
+void enable_tracing(size_t events_per_thread = 65536);
+void disable_tracing();
+
+inline bool tracing_enabled()
+{
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// 'name' must outlive the trace - in practice, a string literal
+class trace_scope_t
+{
+ public:
+    explicit trace_scope_t(const char *name) : name(tracing_enabled() ? name : nullptr)
+    {
+        if (this->name) begin_ns = trace_detail::now_ns();
+    }
+    trace_scope_t(const trace_scope_t &) = delete;
+    trace_scope_t &operator=(const trace_scope_t &) = delete;
+    ~trace_scope_t()
+    {
+        if (name) trace_detail::record(name, begin_ns, trace_detail::now_ns());
+    }
+
+ private:
+    const char *name;
+    uint64_t begin_ns = 0;
+};
+
+std::string format_trace();
+bool write_trace(const std::filesystem::path &path);
+
+#endif /* LICENSE_TRACE_HPP */
@@ -0,0 +1,249 @@
+#include "license-validity.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+constexpr uint32_t no_node = std::numeric_limits<uint32_t>::max();
+
+int32_t to_days(const date::year_month_day &day)
+{
+    return date::sys_days{day}.time_since_epoch().count();
+}
+
+date::year_month_day from_days(int32_t days)
+{
+    return date::year_month_day{date::sys_days{date::days{days}}};
+}
+} // namespace
+
+uint32_t validity_index_t::add(std::string id, const date::year_month_day &issue_date, const expiry_t &expiry)
+{
+    ids.push_back(std::move(id));
+    starts.push_back(to_days(issue_date));
+    ends.push_back(to_days(resolve_expiry(issue_date, expiry)));
+    nodes.clear();
+    by_start.clear();
+    by_end.clear();
+    by_expiry.clear();
+    return static_cast<uint32_t>(ids.size() - 1);
+}
+
+uint32_t validity_index_t::add(std::string id, const date::year_month_day &issue_date, const license_t &license)
+{
+    return add(std::move(id), issue_date, expiry_t{resolve_expiry(issue_date, license)});
+}
+
+date::year_month_day validity_index_t::issued(uint32_t license) const
+{
+    return from_days(starts[license]);
+}
+
+date::year_month_day validity_index_t::expiry(uint32_t license) const
+{
+    return from_days(ends[license]);
+}
+
+void validity_index_t::build()
+{
+    nodes.clear();
+    by_start.clear();
+    by_end.clear();
+    std::vector<uint32_t> members;
+    for (uint32_t license = 0; license < ids.size(); ++license)
+    {
+        // A license that expired before it was issued is never valid
+        if (starts[license] <= ends[license]) members.push_back(license);
+    }
+    build_node(members);
+
+    by_expiry.resize(ids.size());
+    for (uint32_t license = 0; license < ids.size(); ++license)
+        by_expiry[license] = license;
+    std::stable_sort(by_expiry.begin(), by_expiry.end(), [&](uint32_t l, uint32_t r) { return ends[l] < ends[r]; });
+}
+
+uint32_t validity_index_t::build_node(std::vector<uint32_t> &members)
+{
+    if (members.empty()) return no_node;
+
+    // The median endpoint leaves at most half the intervals wholly on either side, so the tree is O(log n) deep
+    std::vector<int32_t> endpoints;
+    endpoints.reserve(members.size() * 2);
+    for (const auto license : members)
+    {
+        endpoints.push_back(starts[license]);
+        endpoints.push_back(ends[license]);
+    }
+    const auto middle = endpoints.begin() + static_cast<std::ptrdiff_t>(endpoints.size() / 2);
+    std::nth_element(endpoints.begin(), middle, endpoints.end());
+    const auto center = *middle;
+
+    std::vector<uint32_t> left;
+    std::vector<uint32_t> right;
+    std::vector<uint32_t> here;
+    for (const auto license : members)
+    {
+        if (ends[license] < center)
+            left.push_back(license);
+        else if (starts[license] > center)
+            right.push_back(license);
+        else
+            here.push_back(license);
+    }
+    members.clear();
+    members.shrink_to_fit();
+
+    const auto number = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({center, static_cast<uint32_t>(by_start.size()), static_cast<uint32_t>(here.size()), no_node,
+                     no_node});
+    std::sort(here.begin(), here.end(), [&](uint32_t l, uint32_t r) { return starts[l] < starts[r]; });
+    by_start.insert(by_start.end(), here.begin(), here.end());
+    std::sort(here.begin(), here.end(), [&](uint32_t l, uint32_t r) { return ends[l] > ends[r]; });
+    by_end.insert(by_end.end(), here.begin(), here.end());
+
+    // 'nodes' may grow while the children are built
+    const auto left_node = build_node(left);
+    const auto right_node = build_node(right);
+    nodes[number].left = left_node;
+    nodes[number].right = right_node;
+    return number;
+}
+
+void validity_index_t::active_on(const date::year_month_day &day, std::vector<uint32_t> &licenses) const
+{
+    licenses.clear();
+    const auto d = to_days(day);
+    for (auto n = nodes.empty() ? no_node : 0; n != no_node;)
+    {
+        const auto &node = nodes[n];
+        const auto first = node.first;
+        const auto last = node.first + node.count;
+        if (d < node.center)
+        {
+            // Every interval here ends at or after the center, so it contains 'd' if it starts by then
+            for (auto i = first; i < last && starts[by_start[i]] <= d; ++i)
+                licenses.push_back(by_start[i]);
+            n = node.left;
+        }
+        else if (d > node.center)
+        {
+            for (auto i = first; i < last && ends[by_end[i]] >= d; ++i)
+                licenses.push_back(by_end[i]);
+            n = node.right;
+        }
+        else
+        {
+            licenses.insert(licenses.end(), by_start.begin() + first, by_start.begin() + last);
+            break;
+        }
+    }
+}
+
+void validity_index_t::expiring_between(const date::year_month_day &first,
+                                        const date::year_month_day &last,
+                                        std::vector<uint32_t> &licenses) const
+{
+    licenses.clear();
+    const auto from = std::lower_bound(by_expiry.begin(), by_expiry.end(), to_days(first),
+                                       [&](uint32_t license, int32_t day) { return ends[license] < day; });
+    const auto to = std::upper_bound(from, by_expiry.end(), to_days(last),
+                                     [&](int32_t day, uint32_t license) { return day < ends[license]; });
+    licenses.assign(from, to);
+}
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "license-parser.hpp"
+
+#include <random>
+
+TEST_CASE("validity_index_t")
+{
+    using namespace date;
+    validity_index_t index;
+    index.add("fixed", 2019_y / 1 / 1, 2019_y / 12 / 12);
+    index.add("term", 2019_y / 7 / 30, term_length_t{2, term_length_t::week});
+    index.add("perpetual", 2019_y / 12 / 13, perpetual_t{});
+    index.add("backwards", 2019_y / 6 / 1, 2019_y / 5 / 1);
+    // The fixed date has passed, so the term length does not extend it
+    const auto past = *parse_license(2019_y / 7 / 30, "secret=p\nexpiry=2019-01-01\nexpiry=1 month", std::nullopt);
+    REQUIRE(index.add("past", 2019_y / 7 / 30, past) == 4);
+    index.build();
+    REQUIRE(index.expiry(1) == 2019_y / 8 / 13);
+    REQUIRE(index.expiry(4) == 2019_y / 1 / 1);
+
+    std::vector<uint32_t> found;
+    index.active_on(2019_y / 12 / 12, found);
+    REQUIRE(found == std::vector<uint32_t>{0});
+    index.active_on(2019_y / 8 / 1, found);
+    std::sort(found.begin(), found.end());
+    REQUIRE(found == std::vector<uint32_t>{0, 1});
+    index.active_on(2019_y / 5 / 15, found);
+    REQUIRE(found == std::vector<uint32_t>{0});
+    index.active_on(2100_y / 1 / 1, found);
+    REQUIRE(found == std::vector<uint32_t>{2});
+    index.active_on(2018_y / 1 / 1, found);
+    REQUIRE(found.empty());
+
+    index.expiring_between(2019_y / 5 / 1, 2019_y / 12 / 12, found);
+    REQUIRE(found == std::vector<uint32_t>{3, 1, 0});
+    index.expiring_between(2019_y / 8 / 14, 2019_y / 12 / 11, found);
+    REQUIRE(found.empty());
+
+    SUBCASE("Random intervals agree with a scan")
+    {
+        std::mt19937 random(7);
+        validity_index_t many;
+        const auto base = sys_days{2000_y / 1 / 1};
+        for (int i = 0; i < 3000; ++i)
+        {
+            const auto issued = year_month_day{base + days{random() % 7000}};
+            expiry_t expiry = perpetual_t{};
+            switch (random() % 4)
+            {
+            case 0:
+                expiry = year_month_day{base + days{random() % 7000}};
+                break;
+            case 1:
+                expiry = term_length_t{static_cast<uint16_t>(1 + random() % 30),
+                                       static_cast<term_length_t::units_t>(random() % 4)};
+                break;
+            case 2:
+                expiry = term_length_t{1, term_length_t::year};
+                break;
+            }
+            many.add(std::to_string(i), issued, expiry);
+        }
+        many.build();
+
+        for (int q = 0; q < 200; ++q)
+        {
+            const auto day = year_month_day{base + days{static_cast<int>(random() % 8000) - 500}};
+            CAPTURE(day);
+            std::vector<uint32_t> expected;
+            for (uint32_t license = 0; license < many.size(); ++license)
+            {
+                if (many.issued(license) <= day && day <= many.expiry(license)) expected.push_back(license);
+            }
+            many.active_on(day, found);
+            std::sort(found.begin(), found.end());
+            REQUIRE(found == expected);
+
+            const auto last = year_month_day{sys_days{day} + days{random() % 60}};
+            expected.clear();
+            for (uint32_t license = 0; license < many.size(); ++license)
+            {
+                if (day <= many.expiry(license) && many.expiry(license) <= last) expected.push_back(license);
+            }
+            many.expiring_between(day, last, found);
+            REQUIRE(std::is_sorted(found.begin(), found.end(),
+                                   [&](uint32_t l, uint32_t r) { return many.expiry(l) < many.expiry(r); }));
+            std::sort(found.begin(), found.end());
+            REQUIRE(found == expected);
+        }
+    }
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
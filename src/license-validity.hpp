@@ -0,0 +1,63 @@
+#ifndef LICENSE_VALIDITY_HPP
+#define LICENSE_VALIDITY_HPP
+
+#include "license.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Answers audit questions over many licenses - "which were valid on this day?" and "which expire between these
+// days?" - in O(log n + k) for k answers. Each license is valid from its issue date to its expiry, with term lengths
+// counted from the issue date. The validity intervals go into a static centered interval tree: each node holds the
+// intervals containing its center, sorted by start and by end, so a query walks one root-to-leaf path and stops
+// scanning each node's list at the first interval that does not contain the day. Expiries are also kept sorted for
+// range queries.
+class validity_index_t
+{
+ public:
+    // Licenses are numbered from 0 in the order they are added. Adding a license discards the index until the next
+    // build.
+    uint32_t add(std::string id, const date::year_month_day &issue_date, const expiry_t &expiry);
+    // Takes the earliest of the license's expiry terms, as resolved_license_t does, not its folded expiry
+    uint32_t add(std::string id, const date::year_month_day &issue_date, const license_t &license);
+    void build();
+
+    size_t size() const { return ids.size(); }
+    const std::string &id(uint32_t license) const { return ids[license]; }
+    date::year_month_day issued(uint32_t license) const;
+    // The last valid day
+    date::year_month_day expiry(uint32_t license) const;
+
+    // Licenses issued on or before 'day' and not expired on it, in no particular order
+    void active_on(const date::year_month_day &day, std::vector<uint32_t> &licenses) const;
+    // Licenses whose last valid day is from 'first' to 'last' inclusive, in order of expiry
+    void expiring_between(const date::year_month_day &first,
+                          const date::year_month_day &last,
+                          std::vector<uint32_t> &licenses) const;
+
+ private:
+    struct tree_node_t
+    {
+        int32_t center;
+        // This node's intervals are [first, first + count) of by_start and of by_end
+        uint32_t first;
+        uint32_t count;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    uint32_t build_node(std::vector<uint32_t> &members);
+
+    std::vector<std::string> ids;
+    // Days since 1970-01-01
+    std::vector<int32_t> starts;
+    std::vector<int32_t> ends;
+
+    std::vector<tree_node_t> nodes;
+    std::vector<uint32_t> by_start;
+    std::vector<uint32_t> by_end;
+    std::vector<uint32_t> by_expiry;
+};
+
+#endif /* LICENSE_VALIDITY_HPP */
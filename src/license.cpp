@@ -1,5 +1,7 @@
 #include "license.hpp"
 
+#include <algorithm>
+
 #include <doctest/doctest.h>
 
 date::year_month_day term_length_t::get_term_end(const date::year_month_day &start) const
@@ -104,6 +106,59 @@ TEST_CASE("test expiry comparisons")
             expiry_t{2020_y / 2 / 12});
 }
 
+date::year_month_day resolve_expiry(const date::year_month_day &issue_date, const expiry_t &expiry)
+{
+    return std::visit(overloaded{[](const date::year_month_day &d) { return d; },
+                                 [&](const term_length_t &t) { return t.get_term_end(issue_date); },
+                                 [](const perpetual_t &) {
+                                     return date::year_month_day{date::year::max(), date::month{12}, date::day{31}};
+                                 }},
+                      expiry);
+}
+
+date::year_month_day resolve_expiry(const date::year_month_day &issue_date, const license_t &license)
+{
+    auto earliest = resolve_expiry(issue_date, perpetual_t{});
+    bool any = false;
+    for (const auto &term : license.terms)
+    {
+        if (const auto *expiry = std::get_if<expiry_t>(&term))
+        {
+            earliest = std::min(earliest, resolve_expiry(issue_date, *expiry));
+            any = true;
+        }
+    }
+    return any ? earliest : resolve_expiry(issue_date, license.expiry);
+}
+
+TEST_CASE("resolve_expiry")
+{
+    using namespace date;
+    const auto issued = 2019_y / 07 / 30;
+    REQUIRE(resolve_expiry(issued, 2019_y / 1 / 1) == 2019_y / 1 / 1);
+    REQUIRE(resolve_expiry(issued, 2020_y / 1 / 1) == 2020_y / 1 / 1);
+    REQUIRE(resolve_expiry(issued, term_length_t{2, term_length_t::day}) == 2019_y / 8 / 1);
+    REQUIRE(resolve_expiry(issued, perpetual_t{}) == year::max() / 12 / 31);
+
+    SUBCASE("A past date stays past alongside a term length, in either order")
+    {
+        license_t license;
+        license.terms = {expiry_t{2019_y / 1 / 1}, expiry_t{term_length_t{1, term_length_t::month}}};
+        for (const auto &term : license.terms)
+            license.process_term(issued, term);
+        REQUIRE(resolve_expiry(issued, license) == 2019_y / 1 / 1);
+        std::reverse(license.terms.begin(), license.terms.end());
+        REQUIRE(resolve_expiry(issued, license) == 2019_y / 1 / 1);
+    }
+    SUBCASE("Without terms, the folded expiry is used")
+    {
+        license_t license;
+        REQUIRE(resolve_expiry(issued, license) == year::max() / 12 / 31);
+        license.expiry = 2019_y / 1 / 1;
+        REQUIRE(resolve_expiry(issued, license) == 2019_y / 1 / 1);
+    }
+}
+
 void license_t::process_term(const date::year_month_day &eval_date, const license_term_t &term)
 {
     std::visit(overloaded{[&](secret_t const &s) { secret = s.get(); },
@@ -238,3 +293,45 @@ TEST_CASE("test term processing")
         REQUIRE(l.expiry == expiry_t{2019_y / 8 / 8});
     }
 }
+
+#if !defined(DOCTEST_CONFIG_DISABLE)
+#include "test-allocations.hpp"
+
+// Expiry dates are plain values, so comparing them never allocates; folding terms only allocates to copy strings and
+// grow the term lists. See the parse budgets in license-parser.cpp.
+TEST_CASE("allocation budgets for term processing")
+{
+    using namespace date;
+    const auto now = 2019_y / 07 / 30;
+    SUBCASE("get_earliest_expiry")
+    {
+        const allocation_counter_t counter;
+        auto expiry = get_earliest_expiry(now, perpetual_t{}, term_length_t{2, term_length_t::month});
+        expiry = get_earliest_expiry(now, expiry, 2019_y / 12 / 12);
+        expiry = get_earliest_expiry(now, expiry, 2012_y / 5 / 23);
+        REQUIRE(counter.counts().allocations == 0);
+        // Dates already past never expire a license
+        REQUIRE(expiry == expiry_t{term_length_t{2, term_length_t::month}});
+    }
+    SUBCASE("process_term")
+    {
+        // The terms of test/test.lic
+        const std::vector<license_term_t> terms = {secret_t{"plnink plonk abb"},
+                                                   expiry_t{term_length_t{2, term_length_t::month}},
+                                                   expiry_t{2019_y / 12 / 12},
+                                                   expiry_t{2012_y / 5 / 23},
+                                                   identity_t{anyone_t{}},
+                                                   identity_t{user_t{"stu"}},
+                                                   identity_t{domain_t{"methods"}},
+                                                   location_t{anywhere_t{}},
+                                                   location_t{node_t{"cabbage"}}};
+        license_t l;
+        const allocation_counter_t counter;
+        for (const auto &term : terms)
+            l.process_term(now, term);
+        const auto counts = counter.counts();
+        REQUIRE(counts.allocations <= 4);
+        REQUIRE(counts.bytes <= 256);
+    }
+}
+#endif // !defined(DOCTEST_CONFIG_DISABLE)
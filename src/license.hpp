@@ -3,6 +3,7 @@
 
 #include "overloaded.hpp"
 
+#include <array>
 #include <chrono>
 #include <variant>
 #include <vector>
@@ -50,17 +51,42 @@ auto to_date(const date::year_month_day &eval_date, const term_length_t &t);
 
 expiry_t get_earliest_expiry(const date::year_month_day &eval_date, const expiry_t &l, const expiry_t &r);
 
+// The last day a license with this expiry is valid, counting a term length from the day it was issued. Unlike
+// to_date, a date already past stays in the past.
+date::year_month_day resolve_expiry(const date::year_month_day &issue_date, const expiry_t &expiry);
+
 using secret_t = fluent::NamedType<std::string, struct secret_tag, fluent::Comparable>;
 
 struct anywhere_t
 {
 };
+inline bool operator==(const anywhere_t &, const anywhere_t &)
+{
+    return true;
+}
 using node_t = fluent::NamedType<std::string, struct node_tag, fluent::Comparable>;
-using location_t = std::variant<anywhere_t, node_t>;
+using node_pattern_t = fluent::NamedType<std::string, struct node_pattern_tag, fluent::Comparable>;
+// IPv4 addresses are held as IPv4-mapped IPv6 addresses (::ffff:a.b.c.d), so one 128-bit form covers both
+using ip_address_t = std::array<uint8_t, 16>;
+struct network_t
+{
+    ip_address_t address{};
+    uint8_t prefix_length = 0;
+    bool is_v4() const;
+};
+inline bool operator==(const network_t &l, const network_t &r)
+{
+    return l.address == r.address && l.prefix_length == r.prefix_length;
+}
+using location_t = std::variant<anywhere_t, node_t, node_pattern_t, network_t>;
 
 struct anyone_t
 {
 };
+inline bool operator==(const anyone_t &, const anyone_t &)
+{
+    return true;
+}
 using user_t = fluent::NamedType<std::string, struct user_tag, fluent::Comparable>;
 using domain_t = fluent::NamedType<std::string, struct domain_tag, fluent::Comparable>;
 using identity_t = std::variant<anyone_t, user_t, domain_t>;
@@ -77,4 +103,9 @@ struct license_t
     void process_term(const date::year_month_day &eval_date, const license_term_t &term);
 };
 
+// The earliest of the license's expiry terms, each resolved as above. The fold that sets license.expiry takes a past
+// fixed date as never expiring, so resolving that alone could outlast a term that is already over. A license with no
+// terms, such as one rebuilt from its resolved fields, has only license.expiry to go on.
+date::year_month_day resolve_expiry(const date::year_month_day &issue_date, const license_t &license);
+
 #endif /* LICENSE_HPP */
@@ -0,0 +1,129 @@
+#include "license-check.hpp"
+#include "license-revocation.hpp"
+#include "license-server.hpp"
+#include "license-shared.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+license_server_t *running = nullptr;
+
+extern "C" void handle_signal(int)
+{
+    if (running) running->stop();
+}
+
+void usage()
+{
+    fmt::print(stderr, "usage: licensed [--socket path] [--shared name] [--revoked file] license-directory\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string_view socket_path = "/tmp/licensed.sock";
+    const char *shared_name = nullptr;
+    const char *revoked_path = nullptr;
+    const char *directory = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto arg = std::string_view(argv[i]);
+        if (arg == "--socket" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (arg == "--shared" && i + 1 < argc)
+            shared_name = argv[++i];
+        else if (arg == "--revoked" && i + 1 < argc)
+            revoked_path = argv[++i];
+        else if (!directory && arg.substr(0, 1) != "-")
+            directory = argv[i];
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (!directory)
+    {
+        usage();
+        return 2;
+    }
+
+    // Term lengths run from the day the daemon loads the licenses
+    const auto today = date::year_month_day{date::floor<date::days>(std::chrono::system_clock::now())};
+    std::vector<std::string> errors;
+    const auto licenses = load_licenses(directory, today, errors);
+    for (const auto &error : errors)
+        fmt::print(stderr, "{}\n", error);
+    license_store_t store(today);
+    for (const auto &loaded : licenses)
+        store.add(loaded.id, resolved_license_t(loaded.license, today));
+    fmt::print(stderr, "{} licenses loaded\n", store.size());
+
+    revocation_set_t revocations;
+    std::error_code ec;
+    auto revoked_modified = std::filesystem::file_time_type{};
+    if (revoked_path)
+    {
+        revoked_modified = std::filesystem::last_write_time(revoked_path, ec);
+        std::string error;
+        if (!revocations.reload(revoked_path, error))
+        {
+            fmt::print(stderr, "{}\n", error);
+            return 1;
+        }
+        fmt::print(stderr, "{} licenses revoked\n", revocations.size());
+        store.use_revocations(&revocations);
+    }
+
+    // Other processes on the host can then attach to the licenses without parsing them
+    std::optional<shared_license_publisher_t> publisher;
+    if (shared_name)
+    {
+        publisher.emplace(shared_name);
+        if (!publisher->publish(encode_license_image(licenses, today)))
+        {
+            fmt::print(stderr, "{}: cannot publish\n", shared_name);
+            return 1;
+        }
+    }
+
+    license_server_t server(store);
+    if (!server.listen(socket_path))
+    {
+        fmt::print(stderr, "{}: cannot listen\n", socket_path);
+        return 1;
+    }
+    running = &server;
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    // The revocation file is read again whenever it changes, while checks go on
+    std::atomic<bool> watching{revoked_path != nullptr};
+    std::thread watcher([&] {
+        while (watching)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            const auto modified = std::filesystem::last_write_time(revoked_path, ec);
+            if (ec || modified == revoked_modified) continue;
+            revoked_modified = modified;
+            std::string error;
+            if (revocations.reload(revoked_path, error))
+                fmt::print(stderr, "{} licenses revoked\n", revocations.size());
+            else
+                fmt::print(stderr, "{}\n", error);
+        }
+    });
+    server.run();
+    watching = false;
+    watcher.join();
+}
@@ -0,0 +1,151 @@
+#include "license-files.hpp"
+#include "license-lint.hpp"
+#include "license-parser.hpp"
+#include "license-trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <peglib.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+struct outcome_t
+{
+    bool readable = false;
+    std::optional<diagnostic_t> problem;
+};
+
+void usage()
+{
+    fmt::print(stderr, "usage: license-lint [-j threads] [--parse] [--trace trace.json] file-or-directory...\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<fs::path> files;
+    bool parse = false;
+    const char *trace_file = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto arg = std::string_view(argv[i]);
+        if (arg == "--parse")
+        {
+            parse = true;
+        }
+        else if (arg == "--trace")
+        {
+            if (i + 1 == argc)
+            {
+                usage();
+                return 2;
+            }
+            trace_file = argv[++i];
+        }
+        else if (arg == "-j")
+        {
+            const auto value = std::string_view(i + 1 < argc ? argv[++i] : "");
+            const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), threads);
+            if (ec != std::errc{} || ptr != value.data() + value.size() || threads == 0)
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if (!collect_license_files(argv[i], files))
+        {
+            fmt::print(stderr, "{}: cannot read directory\n", argv[i]);
+            return 2;
+        }
+    }
+    if (files.empty())
+    {
+        usage();
+        return 2;
+    }
+    std::sort(files.begin(), files.end());
+    if (trace_file) enable_tracing();
+    // The trace is written however the run ends
+    const auto finish = [&](int status) {
+        if (trace_file)
+        {
+            disable_tracing();
+            if (!write_trace(trace_file)) fmt::print(stderr, "{}: cannot write trace\n", trace_file);
+        }
+        return status;
+    };
+
+    std::vector<outcome_t> outcomes(files.size());
+    std::atomic<bool> bad_grammar{false};
+    std::atomic<size_t> next{0};
+    const auto today = date::year_month_day{date::floor<date::days>(std::chrono::system_clock::now())};
+    auto worker = [&] {
+        std::string buffer;
+        // --parse builds and folds each license as an application would, rather than only checking it
+        const auto parser = parse ? prepare_parser() : std::nullopt;
+        if (parse && !parser)
+        {
+            bad_grammar = true;
+            return;
+        }
+        for (auto i = next++; i < files.size(); i = next++)
+        {
+            {
+                const trace_scope_t trace("read");
+                outcomes[i].readable = read_file(files[i], buffer);
+            }
+            if (!outcomes[i].readable) continue;
+            if (!parser)
+            {
+                outcomes[i].problem = lint_license(buffer);
+                continue;
+            }
+            const auto result = try_parse_license(*parser, today, buffer, files[i].string());
+            if (!result.diagnostics.empty()) outcomes[i].problem = result.diagnostics.front();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < std::min<size_t>(threads, files.size()); ++i)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+        t.join();
+    if (bad_grammar)
+    {
+        fmt::print(stderr, "license.peg: bad grammar\n");
+        return finish(2);
+    }
+
+    size_t failed = 0;
+    {
+        const trace_scope_t trace("output");
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            if (!outcomes[i].readable)
+            {
+                ++failed;
+                fmt::print("{}: cannot read file\n", files[i].string());
+            }
+            else if (const auto &problem = outcomes[i].problem)
+            {
+                ++failed;
+                fmt::print("{}:{}:{}: {}\n", files[i].string(), problem->line, problem->column,
+                           to_string(problem->code));
+            }
+        }
+    }
+    fmt::print(stderr, "{} files, {} failed\n", files.size(), failed);
+    return finish(failed == 0 ? 0 : 1);
+}
@@ -0,0 +1,99 @@
+#include "license-check.hpp"
+#include "license-client.hpp"
+#include "license-files.hpp"
+#include "license-load.hpp"
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+void usage()
+{
+    fmt::print(stderr, "usage: license-load [--threads N] [--rate checks-per-second] [--duration seconds] "
+                       "[--socket path] workload-file\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *workload_file = nullptr;
+    const char *socket_path = nullptr;
+    std::vector<std::pair<std::string_view, std::string_view>> overrides;
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto arg = std::string_view(argv[i]);
+        if ((arg == "--threads" || arg == "--rate" || arg == "--duration") && i + 1 < argc)
+            overrides.emplace_back(arg.substr(2), argv[++i]);
+        else if (arg == "--socket" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (!workload_file && arg.substr(0, 1) != "-")
+            workload_file = argv[i];
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (!workload_file)
+    {
+        usage();
+        return 2;
+    }
+
+    std::string text;
+    if (!read_file(workload_file, text))
+    {
+        fmt::print(stderr, "{}: cannot read file\n", workload_file);
+        return 2;
+    }
+    // Options on the command line win over the workload file's
+    for (const auto &[key, value] : overrides)
+        text += fmt::format("\n{}={}", key, value);
+    const auto today = date::year_month_day{date::floor<date::days>(std::chrono::system_clock::now())};
+    std::string error;
+    const auto workload = parse_workload(text, today, error);
+    if (!workload)
+    {
+        fmt::print(stderr, "{}:{}\n", workload_file, error);
+        return 2;
+    }
+
+    load_report_t report;
+    if (socket_path)
+    {
+        // Through licensed, as an application using license_client_t would check, but with nothing kept between
+        // checks: with the client's cache, all but the first few checks would be answered without asking licensed
+        license_client_t::options_t options;
+        options.max_age = std::chrono::steady_clock::duration::zero();
+        license_client_t client(socket_path, options);
+        report = run_load(*workload, [&](const workload_check_t &check) {
+            return client.check(check.id, check.user, check.node, date::sys_days{check.day});
+        });
+        const auto stats = client.stats();
+        fmt::print(stderr, "{} requests to licensed, {} checks sharing another's request\n", stats.requests,
+                   stats.coalesced);
+    }
+    else
+    {
+        if (workload->licenses.empty())
+        {
+            fmt::print(stderr, "{}: no licenses to check against\n", workload_file);
+            return 2;
+        }
+        const auto directory = std::filesystem::path(workload_file).parent_path() / workload->licenses;
+        std::vector<std::string> errors;
+        const auto store = load_license_store(directory, workload->issued, errors);
+        for (const auto &e : errors)
+            fmt::print(stderr, "{}\n", e);
+        fmt::print(stderr, "{} licenses loaded\n", store.size());
+        report = run_load(*workload, [&](const workload_check_t &check) -> std::optional<check_result_t> {
+            return store.check(check.id, check.user, check.node, check.day);
+        });
+    }
+    fmt::print("{}", format_load_report(report));
+}
@@ -0,0 +1,322 @@
+// Generates a C++ recognizer from a peglib grammar. Each rule becomes an inline function returning the length it
+// matches - or 'failed' - exactly as peglib's Definition::parse would, but with no semantic values, no actions and no
+// grammar to load at runtime.
+//
+//     peg-codegen <grammar.peg> <output.hpp> <namespace>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include <peglib.h>
+
+namespace
+{
+std::string char_literal(char32_t c)
+{
+    if (c >= 0x20 && c < 0x7F && c != '\\' && c != '\'') return std::string("'") + static_cast<char>(c) + "'";
+    std::ostringstream out;
+    out << "0x" << std::hex << static_cast<uint32_t>(c);
+    return out.str();
+}
+
+// Visits operators to build their function bodies. function_for names an operator's function, generating it - and
+// so, recursively, the functions of its operands - the first time it is asked for.
+class generator_t : public peg::Ope::Visitor
+{
+ public:
+    std::string function_for(peg::Ope &ope)
+    {
+        if (const auto i = names.find(&ope); i != names.end()) return i->second;
+        const auto name = "op_" + std::to_string(names.size());
+        names.emplace(&ope, name);
+        ope.accept(*this);
+        declarations << "inline size_t " << name << "(const char *s, size_t n, context_t &c);\n";
+        definitions << "inline size_t " << name << "(const char *s, size_t n, [[maybe_unused]] context_t &c)\n{\n"
+                    << body << "}\n\n";
+        return name;
+    }
+
+    void set_whitespace(peg::Ope &ope) { whitespace = function_for(ope); }
+
+    std::string error;
+    std::ostringstream declarations;
+    std::ostringstream definitions;
+
+ private:
+    // Skips whitespace after a literal or token, as peglib does when the grammar defines %whitespace
+    std::string skip_whitespace(const char *condition) const
+    {
+        if (whitespace.empty()) return "";
+        return std::string("    if (") + condition + ")\n    {\n        const auto l = " + whitespace +
+               "(s + i, n - i, c);\n        if (l == failed) return failed;\n        i += l;\n    }\n";
+    }
+
+    void visit(peg::Sequence &ope) override
+    {
+        std::string code = "    size_t i = 0;\n";
+        for (const auto &operand : ope.opes_)
+        {
+            code += "    {\n        const auto len = " + function_for(*operand) +
+                    "(s + i, n - i, c);\n        if (len == failed) return failed;\n        i += len;\n    }\n";
+        }
+        body = code + "    return i;\n";
+    }
+    void visit(peg::PrioritizedChoice &ope) override
+    {
+        std::string code;
+        for (const auto &operand : ope.opes_)
+        {
+            code += "    if (const auto len = " + function_for(*operand) + "(s, n, c); len != failed) return len;\n";
+        }
+        body = code + "    return failed;\n";
+    }
+    void visit(peg::ZeroOrMore &ope) override
+    {
+        body = "    size_t i = 0;\n    while (n - i > 0)\n    {\n        const auto len = " + function_for(*ope.ope_) +
+               "(s + i, n - i, c);\n        if (len == failed) break;\n        i += len;\n    }\n    return i;\n";
+    }
+    void visit(peg::OneOrMore &ope) override
+    {
+        const auto operand = function_for(*ope.ope_);
+        body = "    auto i = " + operand + "(s, n, c);\n    if (i == failed) return failed;\n    while (n - i > 0)\n" +
+               "    {\n        const auto len = " + operand +
+               "(s + i, n - i, c);\n        if (len == failed) break;\n        i += len;\n    }\n    return i;\n";
+    }
+    void visit(peg::Option &ope) override
+    {
+        body = "    const auto len = " + function_for(*ope.ope_) + "(s, n, c);\n    return len == failed ? 0 : len;\n";
+    }
+    void visit(peg::AndPredicate &ope) override
+    {
+        body = "    return " + function_for(*ope.ope_) + "(s, n, c) == failed ? failed : 0;\n";
+    }
+    void visit(peg::NotPredicate &ope) override
+    {
+        body = "    return " + function_for(*ope.ope_) + "(s, n, c) == failed ? 0 : failed;\n";
+    }
+    void visit(peg::LiteralString &ope) override
+    {
+        std::string code = "    size_t i = " + std::to_string(ope.lit_.size()) + ";\n    if (n < i";
+        for (size_t i = 0; i < ope.lit_.size(); ++i)
+        {
+            code += " || s[" + std::to_string(i) + "] != static_cast<char>(" +
+                    char_literal(static_cast<unsigned char>(ope.lit_[i])) + ")";
+        }
+        body = code + ") return failed;\n" + skip_whitespace("!c.in_token && c.whitespace") + "    return i;\n";
+    }
+    void visit(peg::CharacterClass &ope) override
+    {
+        bool ascii = true;
+        std::string condition;
+        for (const auto &[first, last] : ope.ranges_)
+        {
+            ascii &= last < 0x80;
+            if (!condition.empty()) condition += " || ";
+            condition += first == last ? "cp == " + char_literal(first)
+                                       : "(cp >= " + char_literal(first) + " && cp <= " + char_literal(last) + ")";
+        }
+        if (condition.empty()) condition = "false";
+        if (ascii)
+        {
+            // A multi-byte sequence can only decode to a code point outside an ASCII class
+            body = "    if (n < 1) return failed;\n    const auto cp = static_cast<unsigned char>(s[0]);\n"
+                   "    return " +
+                   condition + " ? 1 : failed;\n";
+        }
+        else
+        {
+            body = "    char32_t cp = 0;\n    const auto len = decode_codepoint(s, n, cp);\n"
+                   "    return len != 0 && (" +
+                   condition + ") ? len : failed;\n";
+        }
+    }
+    void visit(peg::Character &ope) override
+    {
+        body = "    return n >= 1 && s[0] == static_cast<char>(" + char_literal(static_cast<unsigned char>(ope.ch_)) +
+               ") ? 1 : failed;\n";
+    }
+    void visit(peg::AnyCharacter &) override
+    {
+        body = "    const auto len = codepoint_length(s, n);\n    return len != 0 && len <= n ? len : failed;\n";
+    }
+    void visit(peg::TokenBoundary &ope) override
+    {
+        // peglib clears in_token on the way out even inside an enclosing token, and skips the whitespace after the
+        // token before it does
+        body = "    c.in_token = true;\n    auto i = " + function_for(*ope.ope_) + "(s, n, c);\n" +
+               "    if (i == failed)\n    {\n        c.in_token = false;\n        return failed;\n    }\n" +
+               skip_whitespace("c.whitespace") + "    c.in_token = false;\n    return i;\n";
+    }
+    void visit(peg::Ignore &ope) override { body = "    return " + function_for(*ope.ope_) + "(s, n, c);\n"; }
+    void visit(peg::WeakHolder &ope) override
+    {
+        body = "    return " + function_for(*ope.weak_.lock()) + "(s, n, c);\n";
+    }
+    void visit(peg::Holder &ope) override { body = "    return rule_" + ope.outer_->name + "(s, n, c);\n"; }
+    void visit(peg::Reference &ope) override
+    {
+        if (!ope.rule_ || ope.rule_->is_macro) error = "macros are not supported";
+        body = "    return rule_" + ope.name_ + "(s, n, c);\n";
+    }
+    void visit(peg::Whitespace &ope) override
+    {
+        body = "    if (c.in_whitespace) return 0;\n    c.in_whitespace = true;\n    const auto len = " +
+               function_for(*ope.ope_) + "(s, n, c);\n    c.in_whitespace = false;\n    return len;\n";
+    }
+    void visit(peg::CaptureScope &) override { unsupported("capture scopes"); }
+    void visit(peg::Capture &) override { unsupported("captures"); }
+    void visit(peg::User &) override { unsupported("user-defined operators"); }
+    void visit(peg::BackReference &) override { unsupported("back references"); }
+
+    void unsupported(const char *what)
+    {
+        error = std::string(what) + " are not supported";
+        body = "    return failed;\n";
+    }
+
+    std::map<const peg::Ope *, std::string> names;
+    std::string whitespace;
+    std::string body;
+};
+
+const char *prologue = R"(
+#include <cstddef>
+
+namespace @NAMESPACE@
+{
+constexpr size_t failed = static_cast<size_t>(-1);
+
+struct context_t
+{
+    // peglib only skips whitespace when parsing from the start rule
+    bool whitespace = false;
+    bool in_token = false;
+    bool in_whitespace = false;
+};
+
+inline size_t codepoint_length(const char *s, size_t n)
+{
+    if (n == 0) return 0;
+    const auto b = static_cast<unsigned char>(s[0]);
+    if ((b & 0x80) == 0) return 1;
+    if ((b & 0xE0) == 0xC0) return 2;
+    if ((b & 0xF0) == 0xE0) return 3;
+    if ((b & 0xF8) == 0xF0) return 4;
+    return 0;
+}
+
+inline size_t decode_codepoint(const char *s, size_t n, char32_t &cp)
+{
+    const auto len = codepoint_length(s, n);
+    if (len == 0 || len > n) return 0;
+    static constexpr unsigned char lead_mask[] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+    cp = static_cast<unsigned char>(s[0]) & lead_mask[len];
+    for (size_t i = 1; i < len; ++i)
+        cp = (cp << 6) | (static_cast<unsigned char>(s[i]) & 0x3F);
+    return len;
+}
+
+)";
+
+std::string replace_all(std::string text, const std::string &from, const std::string &to)
+{
+    for (auto i = text.find(from); i != std::string::npos; i = text.find(from, i + to.size()))
+        text.replace(i, from.size(), to);
+    return text;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 4)
+    {
+        std::cerr << "usage: peg-codegen <grammar.peg> <output.hpp> <namespace>\n";
+        return 2;
+    }
+    std::ostringstream grammar_text;
+    if (auto in = std::ifstream(argv[1], std::ios::in | std::ios::binary))
+        grammar_text << in.rdbuf();
+    else
+    {
+        std::cerr << argv[1] << ": cannot read grammar\n";
+        return 1;
+    }
+
+    const auto text = grammar_text.str();
+    std::string start;
+    const auto grammar = peg::ParserGenerator::parse(text.data(), text.size(), start,
+                                                     [&](size_t line, size_t column, const std::string &message) {
+                                                         std::cerr << argv[1] << ":" << line << ":" << column << ": "
+                                                                   << message << "\n";
+                                                     });
+    if (!grammar) return 1;
+
+    // Rules in name order, so the output only changes when the grammar does
+    std::set<std::string> rules;
+    for (const auto &[name, definition] : *grammar)
+    {
+        if (name.front() != '%') rules.insert(name);
+    }
+
+    generator_t generator;
+    const auto &start_rule = grammar->at(start);
+    if (start_rule.wordOpe) generator.error = "%word is not supported";
+    if (start_rule.whitespaceOpe) generator.set_whitespace(*start_rule.whitespaceOpe);
+    std::ostringstream rule_functions;
+    for (const auto &name : rules)
+    {
+        const auto operand = generator.function_for(*grammar->at(name).get_core_operator());
+        rule_functions << "inline size_t rule_" << name << "(const char *s, size_t n, context_t &c)\n{\n    return "
+                       << operand << "(s, n, c);\n}\n\n";
+    }
+    if (!generator.error.empty())
+    {
+        std::cerr << argv[1] << ": " << generator.error << "\n";
+        return 1;
+    }
+
+    std::ostringstream out;
+    out << "// Generated by peg-codegen from " << std::filesystem::path(argv[1]).filename().string()
+        << " - do not edit\n#pragma once\n"
+        << replace_all(prologue, "@NAMESPACE@", argv[3]);
+    for (const auto &name : rules)
+        out << "inline size_t rule_" << name << "(const char *s, size_t n, context_t &c);\n";
+    out << generator.declarations.str() << "\n" << generator.definitions.str() << rule_functions.str();
+
+    out << "// Entry points, matching Definition::parse for each rule\n";
+    for (const auto &name : rules)
+    {
+        out << "inline size_t match_" << name << "(const char *s, size_t n)\n{\n";
+        if (name == start && start_rule.whitespaceOpe)
+        {
+            // The start rule skips leading whitespace too
+            const auto whitespace = generator.function_for(*start_rule.whitespaceOpe);
+            out << "    context_t c{true};\n    const auto i = " << whitespace << "(s, n, c);\n"
+                << "    if (i == failed) return failed;\n    const auto len = rule_" << name
+                << "(s + i, n - i, c);\n    return len == failed ? failed : i + len;\n}\n\n";
+        }
+        else
+        {
+            out << "    context_t c{};\n    return rule_" << name << "(s, n, c);\n}\n\n";
+        }
+    }
+
+    out << "constexpr const char *start_rule = \"" << start << "\";\n\n"
+        << "struct rule_t\n{\n    const char *name;\n    size_t (*match)(const char *s, size_t n);\n};\n\n"
+        << "constexpr rule_t rules[] = {\n";
+    for (const auto &name : rules)
+        out << "    {\"" << name << "\", match_" << name << "},\n";
+    out << "};\n} // namespace " << argv[3] << "\n";
+
+    // Only touch the output when it changes, so dependents are not rebuilt for nothing
+    std::ostringstream existing;
+    if (auto in = std::ifstream(argv[2], std::ios::in | std::ios::binary)) existing << in.rdbuf();
+    if (existing.str() == out.str()) return 0;
+    if (auto file = std::ofstream(argv[2], std::ios::out | std::ios::binary); file << out.str()) return 0;
+    std::cerr << argv[2] << ": cannot write output\n";
+    return 1;
+}
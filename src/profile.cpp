@@ -0,0 +1,55 @@
+#include "license-files.hpp"
+#include "license-parser.hpp"
+#include "license-profile.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <peglib.h>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char **argv)
+{
+    std::vector<fs::path> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!collect_license_files(argv[i], files))
+        {
+            fmt::print(stderr, "{}: cannot read directory\n", argv[i]);
+            return 2;
+        }
+    }
+    if (files.empty())
+    {
+        fmt::print(stderr, "usage: license-profile file-or-directory...\n");
+        return 2;
+    }
+    std::sort(files.begin(), files.end());
+
+    auto parser = prepare_parser();
+    if (!parser)
+    {
+        fmt::print(stderr, "cannot load license.peg\n");
+        return 2;
+    }
+    const auto today = date::year_month_day{date::floor<date::days>(std::chrono::system_clock::now())};
+    grammar_profiler_t profiler(*parser);
+    std::string buffer;
+    size_t failed = 0;
+    for (const auto &file : files)
+    {
+        if (!read_file(file, buffer))
+        {
+            fmt::print(stderr, "{}: cannot read file\n", file.string());
+            return 2;
+        }
+        if (!try_parse_license(*parser, today, buffer, file.string()).license) ++failed;
+    }
+
+    fmt::print("{}", format_profile(profiler.report()));
+    fmt::print(stderr, "{} files, {} failed to parse\n", files.size(), failed);
+}
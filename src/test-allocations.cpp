@@ -0,0 +1,72 @@
+#include "test-allocations.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+thread_local allocation_counts_t counts;
+
+void *counted_alloc(std::size_t size)
+{
+    ++counts.allocations;
+    counts.bytes += size;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc{};
+}
+
+void *counted_aligned_alloc(std::size_t size, std::align_val_t alignment)
+{
+    ++counts.allocations;
+    counts.bytes += size;
+    const auto align = static_cast<std::size_t>(alignment);
+#if defined(_MSC_VER)
+    if (void *p = _aligned_malloc(size == 0 ? 1 : size, align)) return p;
+#else
+    // aligned_alloc needs the size to be a multiple of the alignment
+    const auto rounded = ((size == 0 ? 1 : size) + align - 1) / align * align;
+    if (void *p = std::aligned_alloc(align, rounded)) return p;
+#endif
+    throw std::bad_alloc{};
+}
+
+void aligned_free(void *p)
+{
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+} // namespace
+
+allocation_counts_t thread_allocation_counts()
+{
+    return counts;
+}
+
+// The array and nothrow forms forward to these by default, so replacing them covers every allocation
+void *operator new(std::size_t size)
+{
+    return counted_alloc(size);
+}
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return counted_aligned_alloc(size, alignment);
+}
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    aligned_free(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    aligned_free(p);
+}
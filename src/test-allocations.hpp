@@ -0,0 +1,32 @@
+#ifndef TEST_ALLOCATIONS_HPP
+#define TEST_ALLOCATIONS_HPP
+
+#include <cstddef>
+
+// test-allocations.cpp replaces the global allocation functions with ones that count every allocation made by the
+// calling thread. Link it only into test and benchmark executables.
+struct allocation_counts_t
+{
+    size_t allocations = 0;
+    size_t bytes = 0;
+};
+
+allocation_counts_t thread_allocation_counts();
+
+// Counts the allocations this thread makes between construction and the call to counts()
+class allocation_counter_t
+{
+ public:
+    allocation_counter_t() : start(thread_allocation_counts()) {}
+
+    allocation_counts_t counts() const
+    {
+        const auto now = thread_allocation_counts();
+        return {now.allocations - start.allocations, now.bytes - start.bytes};
+    }
+
+ private:
+    allocation_counts_t start;
+};
+
+#endif /* TEST_ALLOCATIONS_HPP */
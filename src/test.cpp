@@ -1,12 +1,20 @@
 #include "license-formatters.hpp"
 #include "license-parser.hpp"
+#include "license-trace.hpp"
 #include "license.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <fstream>
+#include <initializer_list>
 #include <sstream>
+#include <string_view>
+#include <vector>
 
 #include <fmt/core.h>
 #include <fmt/ostream.h>
+#include <peglib.h>
 
 std::string read_file(std::string const &filename)
 {
@@ -19,16 +27,125 @@ std::string read_file(std::string const &filename)
     return std::string{};
 }
 
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+// Wall time of each repeat of one phase
+struct phase_t
+{
+    const char *name;
+    std::vector<clock_type::duration> samples;
+};
+
+template <class F>
+auto timed(phase_t &phase, F &&f)
+{
+    const auto start = clock_type::now();
+    auto result = f();
+    phase.samples.push_back(clock_type::now() - start);
+    return result;
+}
+
+void print_stats(std::initializer_list<phase_t *> phases)
+{
+    const auto us = [](clock_type::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+    fmt::print(stderr, "{:<12} {:>8} {:>12} {:>12} {:>12}\n", "phase", "repeats", "min us", "median us", "p99 us");
+    for (auto *phase : phases)
+    {
+        auto &samples = phase->samples;
+        if (samples.empty()) continue;
+        std::sort(samples.begin(), samples.end());
+        const auto p99 = samples[(samples.size() * 99 + 99) / 100 - 1];
+        fmt::print(stderr, "{:<12} {:>8} {:>12.1f} {:>12.1f} {:>12.1f}\n", phase->name, samples.size(),
+                   us(samples.front()), us(samples[samples.size() / 2]), us(p99));
+    }
+}
+
+void usage()
+{
+    fmt::print(stderr, "usage: license [--stats] [--repeat N] [--trace trace.json] file\n");
+}
+} // namespace
+
 int main(int argc, char **argv)
 {
-    if (argc > 1)
+    bool stats = false;
+    size_t repeat = 1;
+    const char *filename = nullptr;
+    const char *trace_file = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto arg = std::string_view(argv[i]);
+        if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (arg == "--repeat")
+        {
+            const auto value = std::string_view(i + 1 < argc ? argv[++i] : "");
+            const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), repeat);
+            if (ec != std::errc{} || ptr != value.data() + value.size() || repeat == 0)
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if (arg == "--trace")
+        {
+            if (i + 1 == argc)
+            {
+                usage();
+                return 2;
+            }
+            trace_file = argv[++i];
+        }
+        else
+        {
+            filename = argv[i];
+        }
+    }
+    if (!filename)
     {
-        const auto file = read_file(argv[1]);
-        const auto today = date::year_month_day{date::floor<date::days>(std::chrono::system_clock::now())};
-        if (const auto license = parse_license(today, file, argv[1]))
+        if (argc > 1) usage();
+        return argc > 1 ? 2 : 0;
+    }
+
+    // Every repeat runs each phase afresh, so the parser is prepared and the file read each time
+    phase_t read{"read", {}}, prepare{"prepare", {}}, parse{"parse_n", {}}, fold{"fold", {}}, format{"format", {}};
+    const auto today = date::year_month_day{date::floor<date::days>(std::chrono::system_clock::now())};
+    std::string output;
+    if (trace_file) enable_tracing();
+    // The trace is written however the run ends, so a failed run leaves its timeline too
+    const auto finish = [&](int status) {
+        if (trace_file)
         {
-            fmt::print("License secret = {}, expiry = {}, locn = {}, id = {}\n", license->secret, license->expiry,
-                       license->allowed_places, license->allowed_users);
+            disable_tracing();
+            if (!write_trace(trace_file)) fmt::print(stderr, "{}: cannot write trace\n", trace_file);
         }
+        return status;
+    };
+    for (size_t i = 0; i < repeat; ++i)
+    {
+        const auto file = timed(read, [&] {
+            const trace_scope_t trace("read");
+            return read_file(filename);
+        });
+        const auto parser = timed(prepare, [] { return prepare_parser(); });
+        if (!parser) return finish(1);
+        auto license = timed(parse, [&] { return parse_license_terms(*parser, file, filename); });
+        if (!license) continue;
+        timed(fold, [&] {
+            fold_license_terms(today, *license);
+            return true;
+        });
+        output = timed(format, [&] {
+            const trace_scope_t trace("format");
+            return fmt::format("License secret = {}, expiry = {}, locn = {}, id = {}\n", license->secret,
+                               license->expiry, license->allowed_places, license->allowed_users);
+        });
     }
+    fmt::print("{}", output);
+    if (stats) print_stats({&read, &prepare, &parse, &fold, &format});
+    return finish(0);
 }